@@ -0,0 +1,335 @@
+#include "headers/blocks.hpp"
+#include <random>
+
+// Times the hot paths of the game on generated levels of increasing size and writes the results as CSV.
+// Every run uses the same seed, so results from different builds are comparable
+namespace platformer
+{
+    namespace benchmark
+    {
+        struct settings
+        {
+            std::vector<int> sizes{1000, 10000, 100000, 1000000};
+            // Fraction of the level's area that is filled with blocks
+            float density{0.3f};
+            // Lasers per 1000 blocks
+            float lasersPerThousand{1.0f};
+            // Fraction of blocks that are animated, not counting lasers
+            float animatedFraction{0.05f};
+            std::string resultsFile{"benchmark.csv"};
+            std::string levelFile{"benchmark.level.tmp"};
+        };
+        struct result
+        {
+            int blocks;
+            std::string stage;
+            int iterations;
+            double totalMilliseconds;
+        };
+        const int staticTypes[] = {Grass, Dirt, Brick, BrickR, BrickO, BrickY, BrickG, BrickB, BrickP, BrickW};
+        // Portals are left out because touching one ends the level
+        const int animatedTypes[] = {Lava, SusJuice, AccessPoint};
+        // Fills a square area row by row so that exactly blockCount blocks are placed, plus one player spawn above the level
+        void generateLevel(int blockCount, settings &options, std::mt19937 &random, std::vector<level::blockRecord> &dest)
+        {
+            dest.clear();
+            dest.reserve(blockCount + 1);
+            long long side = (long long)std::ceil(std::sqrt(blockCount / options.density));
+            long long cellsLeft = side * side;
+            long long blocksLeft = blockCount;
+            float laserChance = options.lasersPerThousand / 1000.0f;
+            std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+            for (long long cell = 0; cell < side * side && blocksLeft > 0; cell++, cellsLeft--)
+            {
+                // Selection sampling, every cell has the same chance to be picked
+                if (chance(random) * cellsLeft >= blocksLeft)
+                {
+                    continue;
+                }
+                blocksLeft--;
+                level::blockRecord record{(int)(cell % side) * 64, (int)(cell / side) * 64, 0, (int)(random() % 4) * 90};
+                float roll = chance(random);
+                if (roll < laserChance)
+                {
+                    record.type = LaserNoTimeOffset;
+                }
+                else if (roll < laserChance + options.animatedFraction)
+                {
+                    record.type = animatedTypes[random() % (sizeof(animatedTypes) / sizeof(int))];
+                    record.rotation = 0;
+                }
+                else
+                {
+                    record.type = staticTypes[random() % (sizeof(staticTypes) / sizeof(int))];
+                }
+                dest.push_back(record);
+            }
+            dest.push_back({(int)(side / 2) * 64, -128, PlayerSpawn, 0});
+        }
+        template <typename T>
+        result timeStage(int blocks, const char *stage, int iterations, T function)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; i++)
+            {
+                function(i);
+            }
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << blocks << " blocks, " << stage << ": " << milliseconds / iterations << " ms (" << iterations << " iterations)" << '\n';
+            return {blocks, stage, iterations, milliseconds};
+        }
+        void run(int blockCount, settings &options, std::vector<result> &results)
+        {
+            std::mt19937 random(blockCount);
+            std::vector<level::blockRecord> records;
+            generateLevel(blockCount, options, random, records);
+            std::vector<tile> staticBlocks;
+            std::vector<stationaryAnimatedBlock> animatedBlocks;
+            triggerIndex triggers;
+            tileGrid grid;
+            Color background{0, 0, 0, 255};
+            const char *file = options.levelFile.c_str();
+            // Every format is loaded the same way, including computing every laser beam
+            level::writeText(file, background, records);
+            results.push_back(timeStage(blockCount, "loadFromFile text", 1, [&](int)
+                                        { blocks::loadFromFile(file, staticBlocks, animatedBlocks, triggers, grid, background); }));
+            level::writeBinary(file, background, records);
+            results.push_back(timeStage(blockCount, "loadFromFile binary", 1, [&](int)
+                                        { blocks::loadFromFile(file, staticBlocks, animatedBlocks, triggers, grid, background); }));
+            level::writeCompressed(file, background, records);
+            results.push_back(timeStage(blockCount, "loadFromFile compressed", 1, [&](int)
+                                        { blocks::loadFromFile(file, staticBlocks, animatedBlocks, triggers, grid, background); }));
+            std::remove(file);
+            std::vector<int> lasers;
+            for (size_t i = 0; i < animatedBlocks.size(); i++)
+            {
+                if (animatedBlocks.at(i).getType() == LaserNoTimeOffset)
+                {
+                    lasers.push_back(i);
+                }
+            }
+            if (!lasers.empty())
+            {
+                results.push_back(timeStage(blockCount, "computeRay", lasers.size(), [&](int i)
+                                            { animatedBlocks.at(lasers.at(i)).computeRay(grid); }));
+            }
+            // The camera sweeps diagonally across the level at a 800x400 resolution, the same as main.cpp each frame
+            visibilityCuller culler;
+            results.push_back(timeStage(blockCount, "culler build", 1, [&](int)
+                                        { culler.build(staticBlocks, animatedBlocks); }));
+            float levelWidth = std::sqrt(blockCount / options.density) * 64;
+            const int frames = 3600;
+            size_t visible{0};
+            results.push_back(timeStage(blockCount, "culler update", frames, [&](int i)
+                                        {
+                                            float progress = (float)i / frames;
+                                            culler.update({levelWidth * progress - 400, levelWidth * progress - 200, 800, 400}, staticBlocks, animatedBlocks);
+                                            visible += culler.getVisibleStatic().size(); }));
+            // Only moves the clip of every type on, the frames of single blocks are worked out when they are drawn
+            animationTable animations;
+            animations.build(animatedBlocks);
+            results.push_back(timeStage(blockCount, "animation update", frames, [&](int i)
+                                        { animations.update(i * blocks::physicsStepSeconds); }));
+            // Queues what the camera sees the same way main.cpp does, but only sorts and counts since there is no window.
+            // The culler is updated in the same loop, so this includes the culling time above
+            renderQueue queue;
+            Texture2D spritesheet{1, 1024, 2048, 1, 7};
+            results.push_back(timeStage(blockCount, "render queue with culling", frames, [&](int i)
+                                        {
+                                            float progress = (float)i / frames;
+                                            culler.update({levelWidth * progress - 400, levelWidth * progress - 200, 800, 400}, staticBlocks, animatedBlocks);
+                                            animations.update(i * blocks::physicsStepSeconds);
+                                            for (int j : culler.getVisibleBeams())
+                                            {
+                                                if (animations.getFrame(j) == 1)
+                                                {
+                                                    queue.addLine(BeamLayer, animatedBlocks.at(j).getRayBegin(), animatedBlocks.at(j).getRayEnd(), 28, {0, 255, 0, 255});
+                                                }
+                                            }
+                                            for (int j : culler.getVisibleStatic())
+                                            {
+                                                blocks::drawTile(queue, staticBlocks.at(j), spritesheet);
+                                            }
+                                            for (int j : culler.getVisibleAnimated())
+                                            {
+                                                animatedBlocks.at(j).draw(queue, spritesheet, animations.getFrame(j));
+                                            }
+                                            queue.flush(false); }));
+            renderQueue::counters drawn = queue.getCounters();
+            std::cout << blockCount << " blocks, per frame: " << (double)drawn.commands / drawn.flushes << " draw commands in " << (double)drawn.batches / drawn.flushes << " batches, " << (double)drawn.freeRotations / drawn.flushes << " not axis aligned" << '\n';
+            // The player starts above the level and runs back and forth while jumping, as in the headless target
+            player subject = blocks::templatePlayer;
+            animatedText text;
+            std::string level = "0";
+            blocks::inputState keys{};
+            results.push_back(timeStage(blockCount, "doPhysicsStep", frames, [&](int i)
+                                        {
+                                            keys[((i / 200) % 2 == 0) ? 0 : 1] = 1;
+                                            keys[2] = (i % 50 == 0);
+                                            subject.doPhysicsStep(staticBlocks, animatedBlocks, triggers, grid, blocks::physicsStepSeconds, (i + 1) * blocks::physicsStepSeconds, level, text);
+                                            blocks::applyInput(subject, keys); }));
+            // Keeps the culling work from being optimised out
+            if (visible == 0)
+            {
+                std::cout << "The camera never saw a block" << '\n';
+            }
+        }
+        // Compares every laser kernel against CheckCollisionPointLine on random beams and times them. Returns false if any
+        // kernel disagrees with raylib even once
+        bool checkLaserKernels(int beams, std::vector<result> &results)
+        {
+            std::mt19937 random(beams);
+            std::uniform_real_distribution<float> coordinate(-4096.0f, 4096.0f);
+            std::uniform_real_distribution<float> offset(-48.0f, 48.0f);
+            std::vector<float> x1(beams), y1(beams), x2(beams), y2(beams);
+            for (int i = 0; i < beams; i++)
+            {
+                // Mostly axis aligned beams on the grid like the game makes, plus free ones and a few of zero length
+                x1[i] = (int)coordinate(random) / 64 * 64 + 32;
+                y1[i] = (int)coordinate(random) / 64 * 64 + 32;
+                int shape = random() % 8;
+                float length = (random() % 64) * 64;
+                x2[i] = x1[i] + (shape == 0 ? length : shape == 1 ? -length : 0);
+                y2[i] = y1[i] + (shape == 2 ? length : shape == 3 ? -length : 0);
+                if (shape >= 4 && shape < 7)
+                {
+                    x2[i] = coordinate(random);
+                    y2[i] = coordinate(random);
+                }
+            }
+            // Points near the middle of each beam, so both hits and misses are common
+            std::vector<Vector2> points(64);
+            for (Vector2 &i : points)
+            {
+                int beam = random() % beams;
+                i = {(x1[beam] + x2[beam]) / 2 + offset(random), (y1[beam] + y2[beam]) / 2 + offset(random)};
+            }
+            std::vector<unsigned char> expected((size_t)beams * points.size());
+            for (size_t p = 0; p < points.size(); p++)
+            {
+                for (int i = 0; i < beams; i++)
+                {
+                    expected[p * beams + i] = CheckCollisionPointLine(points[p], {x1[i], y1[i]}, {x2[i], y2[i]}, triggerIndex::laserReach);
+                }
+            }
+            std::vector<std::pair<const char *, collision::segmentKernel>> kernels{{"scalar", collision::pointNearSegmentsScalar}};
+#ifdef PLATFORMER_X86_KERNELS
+            kernels.push_back({"SSE2", collision::pointNearSegmentsSSE});
+            if (__builtin_cpu_supports("avx"))
+            {
+                kernels.push_back({"AVX", collision::pointNearSegmentsAVX});
+            }
+#endif
+            bool allMatch = true;
+            std::vector<unsigned char> hits((size_t)beams * points.size());
+            for (std::pair<const char *, collision::segmentKernel> &kernel : kernels)
+            {
+                std::string stage = std::string("laser kernel ") + kernel.first + (kernel.second == collision::pointNearSegments ? " (in use)" : "");
+                results.push_back(timeStage(beams, stage.c_str(), points.size(), [&](int p)
+                                            { kernel.second(points[p], triggerIndex::laserReach, x1.data(), y1.data(), x2.data(), y2.data(), beams, hits.data() + (size_t)p * beams); }));
+                size_t mismatches = 0;
+                for (size_t i = 0; i < hits.size(); i++)
+                {
+                    mismatches += hits[i] != expected[i];
+                }
+                if (mismatches > 0)
+                {
+                    std::cerr << "ERROR: The " << kernel.first << " laser kernel disagrees with CheckCollisionPointLine " << mismatches << " times" << '\n';
+                    allMatch = false;
+                }
+            }
+            return allMatch;
+        }
+        bool writeResults(const char *filename, settings &options, std::vector<result> &results)
+        {
+            std::ofstream output(filename, std::ios::out | std::ios::trunc);
+            if (!output)
+            {
+                return false;
+            }
+            output << "blocks,density,lasers_per_thousand,animated_fraction,stage,iterations,total_ms,mean_ms" << '\n';
+            for (result &entry : results)
+            {
+                output << entry.blocks << ',' << options.density << ',' << options.lasersPerThousand << ',' << options.animatedFraction << ',' << entry.stage << ',' << entry.iterations << ',' << entry.totalMilliseconds << ',' << entry.totalMilliseconds / entry.iterations << '\n';
+            }
+            return (bool)output;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    platformer::benchmark::settings options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Usage: " << argv[0] << " [--sizes 1000,10000,...] [--density <0-1>] [--lasers <per 1000 blocks>] [--animated <0-1>] [--output <file>]" << '\n';
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (argument == "--sizes")
+        {
+            options.sizes.clear();
+            std::stringstream list(value);
+            std::string size;
+            while (std::getline(list, size, ','))
+            {
+                options.sizes.push_back(std::atoi(size.c_str()));
+            }
+        }
+        else if (argument == "--density")
+        {
+            options.density = std::atof(value.c_str());
+        }
+        else if (argument == "--lasers")
+        {
+            options.lasersPerThousand = std::atof(value.c_str());
+        }
+        else if (argument == "--animated")
+        {
+            options.animatedFraction = std::atof(value.c_str());
+        }
+        else if (argument == "--output")
+        {
+            options.resultsFile = value;
+        }
+        else
+        {
+            std::cerr << "ERROR: Unknown option " << argument << '\n';
+            return 1;
+        }
+    }
+    if (options.density <= 0 || options.density > 1)
+    {
+        std::cerr << "ERROR: Density must be above 0 and at most 1" << '\n';
+        return 1;
+    }
+    for (int size : options.sizes)
+    {
+        if (size <= 0)
+        {
+            std::cerr << "ERROR: Sizes must be positive" << '\n';
+            return 1;
+        }
+    }
+    platformer::blocks::init();
+    platformer::jobs::init();
+    std::vector<platformer::benchmark::result> results;
+    if (!platformer::benchmark::checkLaserKernels(4096, results))
+    {
+        return 1;
+    }
+    for (int size : options.sizes)
+    {
+        platformer::benchmark::run(size, options, results);
+    }
+    if (!platformer::benchmark::writeResults(options.resultsFile.c_str(), options, results))
+    {
+        std::cerr << "ERROR: Could not write " << options.resultsFile << '\n';
+        return 1;
+    }
+    std::cout << "Wrote " << results.size() << " results to " << options.resultsFile << '\n';
+    return 0;
+}
@@ -1,123 +1,174 @@
 #pragma once
-#include "classes.hpp"
+#include "level.hpp"
+#include "stats.hpp"
+#include <list>
 
 namespace platformer
 {
     namespace blocks
     {
-        stationaryStaticBlock grass;    // 1
-        stationaryStaticBlock dirt;     // 2
-        stationaryStaticBlock brick;    // 3
-        stationaryAnimatedBlock laser;  // 4
-        stationaryAnimatedBlock lava;   // 5
-        player templatePlayer;          // 6
-        stationaryAnimatedBlock portal; // 7
-        stationaryStaticBlock brickR;
-        stationaryStaticBlock brickO;
-        stationaryStaticBlock brickY;
-        stationaryStaticBlock brickG;
-        stationaryStaticBlock brickB;
-        stationaryStaticBlock brickP;
-        stationaryStaticBlock brickW;
-        stationaryAnimatedBlock accessPoint;
-        stationaryAnimatedBlock susJuice;
+        // Indexed by (valuesOfBlocks - Grass). Only animated blocks are filled in, other kinds are never copied from here
+        std::array<stationaryAnimatedBlock, blockCount> animatedPrototypes;
+        player templatePlayer;
         Camera2D inGameCamera;
         void init()
         {
-            grass.setPositionOnSpriteSheet({0, 0, 64, 64});
-            dirt.setPositionOnSpriteSheet({64, 0, 64, 64});
-            brick.setPositionOnSpriteSheet({128, 0, 64, 64});
-            laser.setInitialPositionOnSpriteSheet({0, 1792, 64, 64});
-            portal.setInitialPositionOnSpriteSheet({0, 192, 64, 64});
-            brickR.setPositionOnSpriteSheet({512, 0, 64, 64});
-            brickO.setPositionOnSpriteSheet({448, 0, 64, 64});
-            brickY.setPositionOnSpriteSheet({384, 0, 64, 64});
-            brickG.setPositionOnSpriteSheet({320, 0, 64, 64});
-            brickB.setPositionOnSpriteSheet({256, 0, 64, 64});
-            brickP.setPositionOnSpriteSheet({256, 64, 64, 64});
-            brickW.setPositionOnSpriteSheet({320, 64, 64, 64});
-            accessPoint.setInitialPositionOnSpriteSheet({576, 0, 64, 64});
-            susJuice.setInitialPositionOnSpriteSheet({0, 1664, 64, 64});
-            portal.setPixelsToOffset(64, 0);
-            portal.setMaxFrames(5);
-            laser.setPixelsToOffset(64, 0);
-            laser.setMaxFrames(2);
-            lava.setInitialPositionOnSpriteSheet({0, 1856, 64, 64});
-            lava.setPixelsToOffset(20, 0);
-            lava.setMaxFrames(6);
-            accessPoint.setMaxFrames(2);
-            accessPoint.setPixelsToOffset(64, 0);
-            accessPoint.setDimentions(128, 128);
-            susJuice.setMaxFrames(5);
-            susJuice.setPixelsToOffset(64, 0);
-            grass.setType(valuesOfBlocks::Grass);
-            dirt.setType(valuesOfBlocks::Dirt);
-            brick.setType(valuesOfBlocks::Brick);
-            laser.setType(valuesOfBlocks::LaserNoTimeOffset);
-            lava.setType(valuesOfBlocks::Lava);
-            portal.setType(valuesOfBlocks::Portal);
-            brickR.setType(valuesOfBlocks::BrickR);
-            brickO.setType(valuesOfBlocks::BrickO);
-            brickY.setType(valuesOfBlocks::BrickY);
-            brickG.setType(valuesOfBlocks::BrickG);
-            brickB.setType(valuesOfBlocks::BrickB);
-            brickP.setType(valuesOfBlocks::BrickP);
-            brickW.setType(valuesOfBlocks::BrickW);
-            accessPoint.setType(valuesOfBlocks::AccessPoint);
-            susJuice.setType(valuesOfBlocks::SusJuice);
-            templatePlayer.setInitialPositionOnSpriteSheet({0, 1984, 64, 64});
-            templatePlayer.setPixelsToOffset(64, 0);
-            templatePlayer.setMaxFrames(5);
+            for (int i = 0; i < blockCount; i++)
+            {
+                const blockInfo &info = blockRegistry[i];
+                if (info.kind == blockKinds::AnimatedBlock)
+                {
+                    animatedPrototypes[i].setInitialPositionOnSpriteSheet(info.positionOnSpriteSheet);
+                    animatedPrototypes[i].setPixelsToOffset(info.frameStride.x, info.frameStride.y);
+                    animatedPrototypes[i].setMaxFrames(info.frames);
+                    animatedPrototypes[i].setFrameSeconds(info.frameSeconds);
+                    animatedPrototypes[i].setDimentions(info.width, info.height);
+                    animatedPrototypes[i].setType(info.id);
+                }
+            }
+            const blockInfo &spawn = getBlockInfo(valuesOfBlocks::PlayerSpawn);
+            templatePlayer.setInitialPositionOnSpriteSheet(spawn.positionOnSpriteSheet);
+            templatePlayer.setPixelsToOffset(spawn.frameStride.x, spawn.frameStride.y);
+            templatePlayer.setMaxFrames(spawn.frames);
+            templatePlayer.setFrameSeconds(spawn.frameSeconds);
             inGameCamera.offset = {400, 200};
             inGameCamera.rotation = 0;
             inGameCamera.zoom = 1;
         }
-        void incrementEveryMilliseconds(size_t &iterator, bool &workerLife, int ms)
+        // Held keys, written by the render thread every frame and consumed by the physics thread
+        typedef std::array<std::atomic<int>, 5> inputState;
+        // Applies one tick of input. Movement and checkpoint keys are consumed, jump is held
+        void applyInput(player &pplayer, inputState &activeKeypresses)
         {
-
-            while (workerLife)
+            if (activeKeypresses[0].exchange(0))
+            {
+                pplayer.incrementDesiredMovement(pplayer.getSpeed(), 0);
+                pplayer.setFaceDirection(0);
+            }
+            if (activeKeypresses[1].exchange(0))
+            {
+                pplayer.decrementDesiredMovement(pplayer.getSpeed(), 0);
+                pplayer.setFaceDirection(64);
+            }
+            if (activeKeypresses[2])
+            {
+                pplayer.jump();
+            }
+            if (activeKeypresses[3].exchange(0))
             {
-                iterator++;
-                std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+                pplayer.setCheckpoint(pplayer.getPosition().x, pplayer.getPosition().y);
             }
         }
-        void Every16Milliseconds(std::vector<platformer::stationaryStaticBlock> &staticBlocks, std::vector<platformer::stationaryAnimatedBlock> &animatedBlocks, player &pplayer, bool &workerStatus, std::vector<int> &activeKeypresses, float &tickRate, std::string &file, platformer::animatedText &aniText, double &time)
+        // Length of one physics step. frameDelta passed to the player is tickRate, which is 0 while paused
+        constexpr double physicsStepSeconds = 1.0 / 60.0;
+        // Steps run back to back after a stall before the remaining time is dropped
+        constexpr int maxCatchUpSteps = 5;
+        // Everything the render thread needs from one physics step. It is copied whole, so it holds no pointers
+        struct frameSnapshot
         {
+            std::chrono::steady_clock::time_point steppedAt;
+            Vector2 previousPosition{0, 0};
+            Vector2 position{0, 0};
+            int faceDirection{0};
+            bool reloadLevel{0};
+            // The newest message for the HUD. hudSequence changes whenever there is a new one
+            unsigned int hudSequence{0};
+            char hudMessage[128] = {0};
+            float hudTimeToLive{0};
+            // The simulation clock before and after the last step. It stops while the game is paused
+            double previousSimulationTime{0};
+            double simulationTime{0};
+            // How far the render thread is between the last two steps. Drawing runs one step behind physics so it never extrapolates
+            float getAlpha(std::chrono::steady_clock::time_point now) const
+            {
+                float alpha = std::chrono::duration<float>(now - steppedAt).count() / physicsStepSeconds;
+                return std::min(std::max(alpha, 0.0f), 1.0f);
+            }
+            Vector2 getPlayerPosition(std::chrono::steady_clock::time_point now) const
+            {
+                float alpha = getAlpha(now);
+                return {previousPosition.x + (position.x - previousPosition.x) * alpha, previousPosition.y + (position.y - previousPosition.y) * alpha};
+            }
+            // Animations are drawn at this time, so they stay in step with what physics saw
+            double getSimulationTime(std::chrono::steady_clock::time_point now) const
+            {
+                return previousSimulationTime + (simulationTime - previousSimulationTime) * getAlpha(now);
+            }
+        };
+        // Requests from the render thread, applied by the physics thread before its next step
+        struct simulationRequests
+        {
+            std::atomic<bool> teleport{0};
+            std::atomic<float> teleportX{0};
+            std::atomic<float> teleportY{0};
+        };
+        // Runs physics at a fixed rate on its own thread. The player and file belong to this thread until it is joined,
+        // the render thread only sees what is published to snapshots
+        void fixedStepPhysics(std::vector<platformer::tile> &staticBlocks, std::vector<platformer::stationaryAnimatedBlock> &animatedBlocks, platformer::triggerIndex &triggers, platformer::tileGrid &grid, player &pplayer, std::atomic<bool> &workerStatus, inputState &activeKeypresses, std::atomic<float> &tickRate, simulationRequests &requests, tripleBuffer<frameSnapshot> &snapshots, stats::sampleQueue &stepTimes, std::string &file)
+        {
+            const std::chrono::steady_clock::duration step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(physicsStepSeconds));
+            std::chrono::steady_clock::duration accumulator{0};
+            std::chrono::steady_clock::time_point previousTime = std::chrono::steady_clock::now();
+            // Advances by the tick rate every step, so it is the same on every run with the same input
+            double simulationTime{0};
+            double previousSimulationTime{0};
+            // Messages from physics are collected here and passed on as HUD events
+            platformer::animatedText physicsText;
+            unsigned int publishedRevision = physicsText.getRevision();
+            frameSnapshot latest;
+            pplayer.storePreviousPosition();
             while (workerStatus)
             {
-                std::chrono::_V2::system_clock::time_point estimatedCompletionTime = std::chrono::system_clock::now() + std::chrono::milliseconds(16);
-                pplayer.doPhysicsStep(staticBlocks, animatedBlocks, tickRate, file, aniText);
-                if (activeKeypresses[0])
-                {
-                    pplayer.incrementDesiredMovement(pplayer.getSpeed(), 0);
-                    pplayer.setFaceDirection(0);
-                    activeKeypresses[0] = 0;
-                }
-                if (activeKeypresses[1])
-                {
-                    pplayer.decrementDesiredMovement(pplayer.getSpeed(), 0);
-                    pplayer.setFaceDirection(64);
-                    activeKeypresses[1] = 0;
-                }
-                if (activeKeypresses[2])
-                {
-                    pplayer.jump();
-                }
-                if (activeKeypresses[3])
+                std::chrono::steady_clock::time_point currentTime = std::chrono::steady_clock::now();
+                accumulator += currentTime - previousTime;
+                previousTime = currentTime;
+                int steps{0};
+                // Once a portal is reached the level is over, so nothing moves until the render thread reloads
+                while (accumulator >= step && steps < maxCatchUpSteps && !pplayer.getReloadStatus())
                 {
-                    activeKeypresses[3] = 0;
-                    pplayer.setCheckpoint(pplayer.getPosition().x, pplayer.getPosition().y);
+                    if (requests.teleport.exchange(0))
+                    {
+                        pplayer.setPosition(requests.teleportX, requests.teleportY);
+                    }
+                    pplayer.storePreviousPosition();
+                    float frameDelta = tickRate;
+                    previousSimulationTime = simulationTime;
+                    simulationTime += frameDelta;
+                    std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+                    pplayer.doPhysicsStep(staticBlocks, animatedBlocks, triggers, grid, frameDelta, simulationTime, file, physicsText);
+                    applyInput(pplayer, activeKeypresses);
+                    stepTimes.push(stats::microsecondsSince(stepStart));
+                    accumulator -= step;
+                    steps++;
                 }
-                if (std::chrono::system_clock::now() < estimatedCompletionTime)
+                if (accumulator >= step)
                 {
-                    std::this_thread::sleep_until(estimatedCompletionTime);
+                    // Too far behind to catch up. Drop the backlog so the game slows down instead of spiralling
+                    std::cerr << "WARN: SYSTEM: Physics thread cannot keep up! The game will run slower" << '\n';
+                    physicsText.setContent("WARN: SYSTEM: Physics thread cannot keep up! The game will run slower");
+                    physicsText.revive(simulationTime, 3);
+                    accumulator = accumulator % step;
                 }
-                else
+                if (steps > 0 || physicsText.getRevision() != publishedRevision)
                 {
-                    std::cerr << "WARN: SYSTEM: Physics thread cannot keep up! Physics will be inaccurate" << '\n';
-                    aniText.setContent("WARN: SYSTEM: Physics thread cannot keep up! Physics will be inaccurate");
-                    aniText.revive(time, 3);
+                    latest.steppedAt = previousTime - accumulator;
+                    latest.previousPosition = pplayer.getPreviousPosition();
+                    latest.position = pplayer.getPosition();
+                    latest.faceDirection = pplayer.getFaceDirection();
+                    latest.reloadLevel = pplayer.getReloadStatus();
+                    latest.previousSimulationTime = previousSimulationTime;
+                    latest.simulationTime = simulationTime;
+                    if (physicsText.getRevision() != publishedRevision)
+                    {
+                        publishedRevision = physicsText.getRevision();
+                        latest.hudSequence++;
+                        std::strncpy(latest.hudMessage, physicsText.getContent().c_str(), sizeof(latest.hudMessage) - 1);
+                        latest.hudTimeToLive = physicsText.getTimeToLive();
+                    }
+                    snapshots.getWriteBuffer() = latest;
+                    snapshots.publish();
                 }
+                std::this_thread::sleep_until(previousTime + (step - accumulator));
             }
         }
         namespace blockFunctions
@@ -129,102 +180,220 @@ namespace platformer
                 }
             }
         }
-        void loadFromFile(const char *filename, std::vector<platformer::stationaryStaticBlock> &dest, std::vector<platformer::stationaryAnimatedBlock> &aDest, Color &backgroundColor)
+        void drawTile(renderQueue &queue, tile &toDraw, Texture2D &spritesheet)
+        {
+            queue.addSprite(TileLayer, spritesheet, getBlockInfo(toDraw.type).positionOnSpriteSheet, {toDraw.x * 64.0f + 32, toDraw.y * 64.0f + 32, 64, 64}, {32, 32}, toDraw.rotation * 90, WHITE);
+        }
+        // Static tiles never change while a level is played, so every chunk of them is drawn once into a render texture
+        // the first time it is seen. After that a chunk costs one quad a frame. The least recently seen chunks are
+        // unloaded when the cache grows past its memory budget
+        class chunkCache
         {
-            if (FileExists(filename))
+        public:
+            static const int chunkCells = 16;
+            static const int chunkPixels = chunkCells * tileGrid::cellSize;
+            static const size_t bytesPerChunk = (size_t)chunkPixels * chunkPixels * 4;
+            // Baking switches render targets, so only a few chunks are baked a frame. The rest are drawn tile by tile until then
+            static const int maximumBakesPerFrame = 4;
+
+        protected:
+            struct cachedChunk
             {
-                // std::stringstream source = platformer::readCompressedData(filename);
-                std::ifstream source(filename, std::ios::in);
-                dest.clear();
-                aDest.clear();
+                RenderTexture2D target;
+                std::list<long long>::iterator recentlyUsed;
+            };
+            std::unordered_map<long long, std::vector<int>> tilesByChunk;
+            std::unordered_map<long long, cachedChunk> cached;
+            // Most recently seen chunk first
+            std::list<long long> recentlyUsed;
+            std::vector<long long> visibleBaked;
+            std::vector<long long> visibleUnbaked;
+            // Kept apart from the frame's queue so baking never mixes with what is being drawn to the screen
+            renderQueue bakeQueue;
+            size_t memoryBudget{64 * 1024 * 1024};
+            static long long chunkKey(int chunkX, int chunkY)
+            {
+                return ((long long)chunkX << 32) | (unsigned int)chunkY;
+            }
+            static int chunkX(long long key)
+            {
+                return (int)(key >> 32);
+            }
+            static int chunkY(long long key)
+            {
+                return (int)(unsigned int)key;
+            }
+            void bake(long long key, cachedChunk &destination, std::vector<tile> &staticBlocks, Texture2D &spritesheet)
+            {
+                BeginTextureMode(destination.target);
+                ClearBackground(BLANK);
+                for (int i : tilesByChunk[key])
                 {
-                    std::string placeholder;
-                    std::getline(source, placeholder, '\n');
-                    std::stringstream iDontKnow(placeholder);
-                    std::vector<std::string> colors;
-                    while (std::getline(iDontKnow, placeholder, ' '))
+                    // Moved so that the chunk's top left corner is at the origin of the texture
+                    tile moved = staticBlocks.at(i);
+                    moved.x -= chunkX(key) * chunkCells;
+                    moved.y -= chunkY(key) * chunkCells;
+                    drawTile(bakeQueue, moved, spritesheet);
+                }
+                bakeQueue.flush();
+                EndTextureMode();
+            }
+            void unload(long long key)
+            {
+                std::unordered_map<long long, cachedChunk>::iterator found = cached.find(key);
+                UnloadRenderTexture(found->second.target);
+                recentlyUsed.erase(found->second.recentlyUsed);
+                cached.erase(found);
+            }
+
+        public:
+            // Must be called after a level is loaded. Unloads everything baked for the previous level
+            void build(std::vector<tile> &staticBlocks)
+            {
+                clear();
+                for (size_t i = 0; i < staticBlocks.size(); i++)
+                {
+                    tilesByChunk[chunkKey(level::floorDivide(staticBlocks.at(i).x, chunkCells), level::floorDivide(staticBlocks.at(i).y, chunkCells))].push_back(i);
+                }
+            }
+            void clear()
+            {
+                while (!cached.empty())
+                {
+                    unload(cached.begin()->first);
+                }
+                tilesByChunk.clear();
+                visibleBaked.clear();
+                visibleUnbaked.clear();
+            }
+            // Chunks on screen are never unloaded, even if they alone go over the budget
+            void setMemoryBudget(size_t bytes)
+            {
+                memoryBudget = bytes;
+            }
+            size_t getMemoryUsed()
+            {
+                return cached.size() * bytesPerChunk;
+            }
+            // Bakes chunks that came into view. Must be called outside BeginMode2D and before draw
+            void prepare(Rectangle view, std::vector<tile> &staticBlocks, Texture2D &spritesheet)
+            {
+                PROFILE_ZONE("chunkCache::prepare");
+                visibleBaked.clear();
+                visibleUnbaked.clear();
+                int bakesLeft = maximumBakesPerFrame;
+                int lastX = (int)std::floor((view.x + view.width) / chunkPixels);
+                int lastY = (int)std::floor((view.y + view.height) / chunkPixels);
+                for (int y = (int)std::floor(view.y / chunkPixels); y <= lastY; y++)
+                {
+                    for (int x = (int)std::floor(view.x / chunkPixels); x <= lastX; x++)
                     {
-                        colors.push_back(placeholder);
+                        long long key = chunkKey(x, y);
+                        if (tilesByChunk.find(key) == tilesByChunk.end())
+                        {
+                            continue;
+                        }
+                        std::unordered_map<long long, cachedChunk>::iterator found = cached.find(key);
+                        if (found == cached.end())
+                        {
+                            if (bakesLeft == 0)
+                            {
+                                visibleUnbaked.push_back(key);
+                                continue;
+                            }
+                            bakesLeft--;
+                            recentlyUsed.push_front(key);
+                            found = cached.insert({key, {LoadRenderTexture(chunkPixels, chunkPixels), recentlyUsed.begin()}}).first;
+                            bake(key, found->second, staticBlocks, spritesheet);
+                        }
+                        else
+                        {
+                            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.recentlyUsed);
+                        }
+                        visibleBaked.push_back(key);
                     }
-                    backgroundColor.r = std::stoi(colors.at(0));
-                    backgroundColor.g = std::stoi(colors.at(1));
-                    backgroundColor.b = std::stoi(colors.at(2));
-                    backgroundColor.a = std::stoi(colors.at(3));
                 }
-                std::string lineBuffer;
-                while (std::getline(source, lineBuffer, '\n'))
+                while (getMemoryUsed() > memoryBudget && cached.size() > visibleBaked.size())
                 {
-                    std::vector<int> parsableArguments;
-                    std::stringstream iDontKnow(lineBuffer);
-                    while (std::getline(iDontKnow, lineBuffer, ' '))
+                    unload(recentlyUsed.back());
+                }
+            }
+            // Queues what prepare found on screen
+            void draw(renderQueue &queue, std::vector<tile> &staticBlocks, Texture2D &spritesheet)
+            {
+                PROFILE_ZONE("chunkCache::draw");
+                for (long long key : visibleBaked)
+                {
+                    // Render textures are stored upside down
+                    queue.addSprite(TileLayer, cached[key].target.texture, {0, 0, chunkPixels, -chunkPixels}, {(float)chunkX(key) * chunkPixels, (float)chunkY(key) * chunkPixels, chunkPixels, chunkPixels}, {0, 0}, 0, WHITE);
+                }
+                for (long long key : visibleUnbaked)
+                {
+                    for (int i : tilesByChunk[key])
                     {
-                        parsableArguments.push_back(std::stoi(lineBuffer));
+                        drawTile(queue, staticBlocks.at(i), spritesheet);
                     }
-                    if (parsableArguments.size() == 4)
+                }
+            }
+        };
+        void loadFromFile(const char *filename, std::vector<platformer::tile> &dest, std::vector<platformer::stationaryAnimatedBlock> &aDest, platformer::triggerIndex &triggers, platformer::tileGrid &grid, Color &backgroundColor)
+        {
+            PROFILE_ZONE("blocks::loadFromFile");
+            platformer::level::levelData source;
+            if (FileExists(filename) && source.open(filename))
+            {
+                dest.clear();
+                aDest.clear();
+                grid.clear();
+                backgroundColor = source.getBackground();
+                // Tiles are already in their final form, so they are copied in one go
+                dest.assign(source.getTiles(), source.getTiles() + source.getTileCount());
+                for (size_t i = 0; i < source.getObjectCount(); i++)
+                {
+                    platformer::level::blockRecord cache = source.getObjects()[i];
+                    const blockInfo &info = getBlockInfo(cache.type);
+                    if (!isKnownBlock(cache.type))
                     {
-                        switch (parsableArguments.at(2))
+                        continue;
+                    }
+                    switch (info.kind)
+                    {
+                    case (blockKinds::AnimatedBlock):
+                        aDest.push_back(platformer::stationaryAnimatedBlock(animatedPrototypes[cache.type - valuesOfBlocks::Grass], cache.x, cache.y, info.width, info.height, nullptr, cache.rotation));
+                        if (info.staggered)
                         {
-                        case (platformer::valuesOfBlocks::Grass):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::grass, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::Dirt):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::dirt, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::Brick):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brick, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::LaserNoTimeOffset):
-                            aDest.push_back(platformer::stationaryAnimatedBlock(platformer::blocks::laser, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, nullptr, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::Lava):
-                            aDest.push_back(platformer::stationaryAnimatedBlock(platformer::blocks::lava, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, nullptr, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::PlayerSpawn):
-                            templatePlayer.setPosition(parsableArguments.at(0), parsableArguments.at(1));
-                            templatePlayer.setPosition(parsableArguments.at(0), parsableArguments.at(1));
-                            templatePlayer.setCheckpoint(parsableArguments.at(0), parsableArguments.at(1));
-                            break;
-                        case (platformer::valuesOfBlocks::Portal):
-                            aDest.push_back(platformer::stationaryAnimatedBlock(platformer::blocks::portal, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, nullptr, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickR):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickR, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickO):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickO, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickY):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickY, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickG):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickG, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickB):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickB, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickP):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickP, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::BrickW):
-                            dest.push_back(platformer::stationaryStaticBlock(platformer::blocks::brickW, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::AccessPoint):
-                            aDest.push_back(platformer::stationaryAnimatedBlock(platformer::blocks::accessPoint, parsableArguments.at(0), (parsableArguments.at(1)), 128, 128, nullptr, parsableArguments.at(3)));
-                            break;
-                        case (platformer::valuesOfBlocks::SusJuice):
-                            aDest.push_back(platformer::stationaryAnimatedBlock(platformer::blocks::susJuice, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, nullptr, parsableArguments.at(3)));
-                            break;
-                        default:
-                            break;
+                            aDest.back().setIteratorOffset(aDest.size() - 1);
                         }
+                        break;
+                    case (blockKinds::SpawnPoint):
+                        templatePlayer.setPosition(cache.x, cache.y);
+                        templatePlayer.setCheckpoint(cache.x, cache.y);
+                        break;
+                    default:
+                        break;
                     }
                 }
                 source.close();
+                // The grid only holds solid tiles and belongs to the physics thread. Rendering never writes to it
+                for (size_t i = 0; i < dest.size(); i++)
+                {
+                    if (getBlockInfo(dest.at(i).type).collision == collisionClasses::SolidCollision)
+                    {
+                        grid.insert(dest.at(i).getRectangle(), i);
+                    }
+                }
             }
-            for (int i = 0; i < aDest.size(); i++)
-            {
-                aDest.at(i).computeRay(dest);
-            }
+            // Rays only read the grid, so they are spread over the worker pool
+            jobs::pool.parallelFor(aDest.size(), 256, [&](size_t begin, size_t end)
+                                   {
+                                       for (size_t i = begin; i < end; i++)
+                                       {
+                                           if (aDest.at(i).getType() == valuesOfBlocks::LaserNoTimeOffset)
+                                           {
+                                               aDest.at(i).computeRay(grid);
+                                           }
+                                       } });
+            triggers.build(aDest);
         }
     }
 }
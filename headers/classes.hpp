@@ -1,6 +1,9 @@
 #pragma once
 #include <iostream>
 #include <raylib.h>
+#include <rlgl.h>
+#include "collision.hpp"
+#include "profiler.hpp"
 #include <vector>
 #include <thread>
 #include <mutex>
@@ -9,6 +12,11 @@
 #include <sstream>
 #include <fstream>
 #include <functional>
+#include <unordered_map>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <atomic>
 
 namespace platformer
 {
@@ -35,6 +43,92 @@ namespace platformer
         AccessPoint,
         SusJuice,
     };
+    // How a block is stored once a level is loaded
+    enum blockKinds
+    {
+        StaticTile,
+        AnimatedBlock,
+        SpawnPoint,
+    };
+    enum collisionClasses
+    {
+        NoCollision,
+        SolidCollision,
+        TriggerCollision,
+    };
+    // What happens when the player touches a trigger
+    enum hazardBehaviours
+    {
+        NoHazard,
+        KillsPlayer,
+        KillsPlayerWhenActive,
+        NextLevel,
+        SetsCheckpoint,
+        SusJuiceEffect,
+    };
+    // Everything the game and editor need to know about a type of block
+    struct blockInfo
+    {
+        int id;
+        blockKinds kind;
+        // First frame of the animation
+        Rectangle positionOnSpriteSheet;
+        int frames;
+        // Pixels to move on the spritesheet for every frame
+        Vector2 frameStride;
+        // How long each frame is shown
+        float frameSeconds;
+        // Every block of this type starts on a different frame instead of all of them animating in step
+        bool staggered;
+        int width;
+        int height;
+        collisionClasses collision;
+        hazardBehaviours hazard;
+        // Triggers are shrunk by this many pixels on every side before they are tested against the player
+        int triggerInset;
+    };
+    // Indexed by (valuesOfBlocks - Grass). To add a block, add it to valuesOfBlocks and append a row here
+    constexpr blockInfo blockRegistry[] = {
+        {Grass, StaticTile, {0, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {Dirt, StaticTile, {64, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {Brick, StaticTile, {128, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {LaserNoTimeOffset, AnimatedBlock, {0, 1792, 64, 64}, 2, {64, 0}, 1.0f, 0, 64, 64, TriggerCollision, KillsPlayerWhenActive, 0},
+        {Lava, AnimatedBlock, {0, 1856, 64, 64}, 6, {20, 0}, 0.1f, 1, 64, 64, TriggerCollision, KillsPlayer, 4},
+        {PlayerSpawn, SpawnPoint, {0, 1984, 64, 64}, 5, {64, 0}, 0.1f, 0, 64, 64, NoCollision, NoHazard, 0},
+        {Portal, AnimatedBlock, {0, 192, 64, 64}, 5, {64, 0}, 0.1f, 0, 64, 64, TriggerCollision, NextLevel, 4},
+        {BrickR, StaticTile, {512, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {BrickO, StaticTile, {448, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {BrickY, StaticTile, {384, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {BrickG, StaticTile, {320, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {BrickB, StaticTile, {256, 0, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {BrickP, StaticTile, {256, 64, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {BrickW, StaticTile, {320, 64, 64, 64}, 1, {0, 0}, 0, 0, 64, 64, SolidCollision, NoHazard, 0},
+        {AccessPoint, AnimatedBlock, {576, 0, 64, 64}, 2, {64, 0}, 0.1f, 0, 128, 128, TriggerCollision, SetsCheckpoint, 4},
+        {SusJuice, AnimatedBlock, {0, 1664, 64, 64}, 5, {64, 0}, 0.1f, 1, 64, 64, TriggerCollision, SusJuiceEffect, 4},
+    };
+    constexpr int blockCount = sizeof(blockRegistry) / sizeof(blockInfo);
+    // Returned for ids that are not in the registry
+    constexpr blockInfo unknownBlock = {-1, StaticTile, {0, 0, 0, 0}, 1, {0, 0}, 0, 0, 64, 64, NoCollision, NoHazard, 0};
+    constexpr bool isKnownBlock(int id)
+    {
+        return (unsigned int)(id - Grass) < (unsigned int)blockCount;
+    }
+    constexpr const blockInfo &getBlockInfo(int id)
+    {
+        return isKnownBlock(id) ? blockRegistry[id - Grass] : unknownBlock;
+    }
+    constexpr bool registryIsInOrder()
+    {
+        for (int i = 0; i < blockCount; i++)
+        {
+            if (blockRegistry[i].id != Grass + i)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    static_assert(registryIsInOrder(), "blockRegistry must list blocks in the same order as valuesOfBlocks");
     Vector2 rotatePointAroundOtherPoint(Vector2 origionalPoint, Vector2 pointToRotateAround, float degreesToRotate)
     {
         Vector2 transformedPoint;
@@ -42,26 +136,190 @@ namespace platformer
         transformedPoint.y = (std::sin(degreesToRotate * PI / 180.0f) * (origionalPoint.x - pointToRotateAround.x)) + (std::cos(degreesToRotate * PI / 180.0f) * (origionalPoint.y - pointToRotateAround.y)) + pointToRotateAround.y;
         return transformedPoint;
     }
-    // This function is bugged. Do not use
-    int writeCompressedData(std::stringstream &uncompressedString, const char *filename)
+    // Layers are drawn from first to last. Within a layer, commands are drawn in the order they were added
+    enum renderLayers
+    {
+        BeamLayer,
+        TileLayer,
+        AnimatedLayer,
+        PlayerLayer,
+    };
+    // Collects everything drawn in a frame and hands it to rlgl sorted by layer and texture, so a texture is bound once
+    // for a whole run of sprites instead of every time sprites and laser beams take turns
+    class renderQueue
     {
-        int returnVal = 0;
-        std::fstream output(filename, std::ios::trunc | std::ios::out);
-        if (!output.is_open())
+    public:
+        struct counters
+        {
+            size_t commands{0};
+            // Runs of commands that share a texture. Each one is a single rlBegin and rlEnd
+            size_t batches{0};
+            size_t flushes{0};
+            // Commands that needed sin and cos because they were not rotated by a multiple of 90 degrees
+            size_t freeRotations{0};
+        };
+
+    protected:
+        struct spriteCommand
+        {
+            Rectangle source;
+            Rectangle dest;
+            Vector2 origin;
+            float rotation;
+            Color tint;
+            unsigned short layer;
+            unsigned short texture;
+        };
+        std::vector<spriteCommand> commands;
+        // Layer and texture in the upper half and the index of the command in the lower half, so sorting keeps the order of commands within a layer
+        std::vector<unsigned long long> order;
+        // Slot 0 is rlgl's white texture, used for solid shapes. The rest only hold textures added since the last flush,
+        // since render textures are loaded and unloaded all the time and GL may give a new one the id of an old one
+        std::vector<Texture2D> textures{Texture2D{0, 1, 1, 1, 0}};
+        counters totals;
+        unsigned short getTextureSlot(Texture2D &texture)
+        {
+            for (size_t i = 1; i < textures.size(); i++)
+            {
+                if (textures[i].id == texture.id)
+                {
+                    textures[i] = texture;
+                    return i;
+                }
+            }
+            textures.push_back(texture);
+            return textures.size() - 1;
+        }
+        static bool isQuarterTurn(float rotation)
+        {
+            return rotation / 90.0f == std::floor(rotation / 90.0f);
+        }
+        // Same corners and texture coordinates as DrawTexturePro. Rotations by a multiple of 90 degrees skip sin and cos
+        void emitQuad(spriteCommand &command)
         {
-            returnVal = -1;
+            Texture2D &texture = textures[command.texture];
+            Rectangle source = command.source;
+            bool flipX = false;
+            if (source.width < 0)
+            {
+                flipX = true;
+                source.width *= -1;
+            }
+            if (source.height < 0)
+            {
+                source.y -= source.height;
+            }
+            float cosine;
+            float sine;
+            if (isQuarterTurn(command.rotation))
+            {
+                const float quarterCosines[4] = {1, 0, -1, 0};
+                int turn = (((int)(command.rotation / 90.0f) % 4) + 4) % 4;
+                cosine = quarterCosines[turn];
+                sine = quarterCosines[(turn + 3) % 4];
+            }
+            else
+            {
+                cosine = std::cos(command.rotation * PI / 180.0f);
+                sine = std::sin(command.rotation * PI / 180.0f);
+            }
+            float left = -command.origin.x;
+            float top = -command.origin.y;
+            float right = left + command.dest.width;
+            float bottom = top + command.dest.height;
+            float u1 = source.x / texture.width;
+            float u2 = (source.x + source.width) / texture.width;
+            if (flipX)
+            {
+                std::swap(u1, u2);
+            }
+            float v1 = source.y / texture.height;
+            float v2 = (source.y + source.height) / texture.height;
+            rlColor4ub(command.tint.r, command.tint.g, command.tint.b, command.tint.a);
+            rlTexCoord2f(u1, v1);
+            rlVertex2f(command.dest.x + left * cosine - top * sine, command.dest.y + left * sine + top * cosine);
+            rlTexCoord2f(u1, v2);
+            rlVertex2f(command.dest.x + left * cosine - bottom * sine, command.dest.y + left * sine + bottom * cosine);
+            rlTexCoord2f(u2, v2);
+            rlVertex2f(command.dest.x + right * cosine - bottom * sine, command.dest.y + right * sine + bottom * cosine);
+            rlTexCoord2f(u2, v1);
+            rlVertex2f(command.dest.x + right * cosine - top * sine, command.dest.y + right * sine + top * cosine);
         }
-        else
+
+    public:
+        // Takes the same arguments as DrawTexturePro
+        void addSprite(int layer, Texture2D &texture, Rectangle source, Rectangle dest, Vector2 origin, float rotation, Color tint)
         {
-            int outputSize;
-            unsigned char *compressedData = CompressData((const unsigned char *)uncompressedString.str().c_str(), sizeof(unsigned char) * (uncompressedString.str().length() - 1), &outputSize);
-            output.write((const char *)compressedData, outputSize);
-            output.close();
-            MemFree(compressedData);
-            returnVal = 0;
+            commands.push_back({source, dest, origin, rotation, tint, (unsigned short)layer, getTextureSlot(texture)});
         }
-        return returnVal;
-    }
+        // Takes the same arguments as DrawLineEx
+        void addLine(int layer, Vector2 start, Vector2 end, float thickness, Color color)
+        {
+            float length = std::sqrt((end.x - start.x) * (end.x - start.x) + (end.y - start.y) * (end.y - start.y));
+            if (length <= 0)
+            {
+                return;
+            }
+            commands.push_back({{0, 0, 1, 1}, {start.x, start.y, length, thickness}, {0, thickness / 2}, std::atan2(end.y - start.y, end.x - start.x) * 180.0f / PI, color, (unsigned short)layer, 0});
+        }
+        // Draws and clears everything added since the last flush. Tools without a window pass false to only sort and count
+        void flush(bool submit = true)
+        {
+            PROFILE_ZONE("renderQueue::flush");
+            order.clear();
+            for (size_t i = 0; i < commands.size(); i++)
+            {
+                order.push_back(((unsigned long long)commands[i].layer << 48) | ((unsigned long long)commands[i].texture << 32) | i);
+            }
+            std::sort(order.begin(), order.end());
+            totals.flushes++;
+            totals.commands += commands.size();
+            int boundTexture = -1;
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                spriteCommand &command = commands[(unsigned int)order[i]];
+                if (!isQuarterTurn(command.rotation))
+                {
+                    totals.freeRotations++;
+                }
+                if (command.texture != boundTexture)
+                {
+                    if (submit && boundTexture != -1)
+                    {
+                        rlEnd();
+                    }
+                    boundTexture = command.texture;
+                    totals.batches++;
+                    if (submit)
+                    {
+                        rlSetTexture(boundTexture == 0 ? rlGetTextureIdDefault() : textures[boundTexture].id);
+                        rlBegin(RL_QUADS);
+                        rlNormal3f(0, 0, 1);
+                    }
+                }
+                if (submit)
+                {
+                    emitQuad(command);
+                }
+            }
+            if (submit && boundTexture != -1)
+            {
+                rlEnd();
+                rlSetTexture(0);
+            }
+            commands.clear();
+            textures.resize(1);
+        }
+        // Totals since the last reset
+        counters getCounters()
+        {
+            return totals;
+        }
+        void resetCounters()
+        {
+            totals = counters();
+        }
+    };
     class animatedText
     {
     protected:
@@ -69,6 +327,8 @@ namespace platformer
         float timeToLive;
         double creationTime;
         Vector2 destination;
+        // Counts calls to revive, so another thread can tell when a new message was shown
+        unsigned int revision{0};
 
     public:
         animatedText()
@@ -90,48 +350,33 @@ namespace platformer
         {
             creationTime = timeOfBirth;
             timeToLive = ttl;
+            revision++;
         }
-        void draw(float &c, double time, float fontsize, Vector2 &resolution)
+        const std::string &getContent()
         {
-            if ((creationTime + timeToLive) > time)
-            {
-                DrawText(content.c_str(), (destination.x * resolution.x), (destination.y * resolution.y), fontsize * c, ORANGE);
-            }
+            return content;
         }
-    };
-    // This function is bugged. Do not use
-    std::stringstream readCompressedData(const char *filename)
-    {
-        std::string buffer;
-        std::stringstream thingToReturn;
-        int fileSize = GetFileLength(filename);
-        char *source = LoadFileText(filename);
-        if (source == nullptr)
+        float getTimeToLive()
         {
-            return thingToReturn;
+            return timeToLive;
         }
-        else
+        unsigned int getRevision()
         {
-            int length;
-            int dummy;
-            for (size_t i = 0; source[i] != '\0'; i++)
+            return revision;
+        }
+        void draw(float &c, double time, float fontsize, Vector2 &resolution)
+        {
+            if ((creationTime + timeToLive) > time)
             {
-                buffer += source[i];
-                length = i;
+                DrawText(content.c_str(), (destination.x * resolution.x), (destination.y * resolution.y), fontsize * c, ORANGE);
             }
-            unsigned char *uncompressedData = DecompressData((const unsigned char *)source, fileSize, &dummy);
-            thingToReturn << uncompressedData;
-            MemFree(uncompressedData);
         }
-        UnloadFileText(source);
-        return thingToReturn;
-    }
+    };
     class collidable
     {
     protected:
         Rectangle inGamePositionDimension{0, 0, 64, 64};
         bool collisionEnabled;
-        bool isVisibleToPlayer{0};
         int rotation{0};
 
     public:
@@ -143,13 +388,13 @@ namespace platformer
         {
             rotation = deg;
         }
-        void setVisibility(bool val)
+        void setCollisionStatus(bool val)
         {
-            isVisibleToPlayer = val;
+            collisionEnabled = val;
         }
-        bool getVisibility()
+        bool getCollisionStatus()
         {
-            return isVisibleToPlayer;
+            return collisionEnabled;
         }
         // This position is in game world space
         void setPosition(float x, float y)
@@ -240,14 +485,157 @@ namespace platformer
             return type;
         }
     };
+    // Compact record for a static block. Everything that is the same for every block of a type lives in blockRegistry
+    // instead, so a tile is only 12 bytes no matter how many of them a level holds
+    struct tile
+    {
+        // Position in cells, where a cell is 64x64 pixels
+        int x;
+        int y;
+        // One of valuesOfBlocks
+        unsigned char type;
+        // Number of 90 degree clockwise turns
+        unsigned char rotation;
+        // This position is in game world space
+        Vector2 getPosition()
+        {
+            return {(float)(x * 64), (float)(y * 64)};
+        }
+        Rectangle getRectangle()
+        {
+            return {(float)(x * 64), (float)(y * 64), 64, 64};
+        }
+    };
+    // Dense grid of static block indices, split into square chunks so only the parts of a level that
+    // actually contain blocks take up memory. A cell is one 64x64 block and holds -1 when empty
+    class tileGrid
+    {
+    public:
+        static const int cellSize = 64;
+        static const int chunkSize = 32;
+
+    protected:
+        struct chunk
+        {
+            std::array<int, chunkSize * chunkSize> cells;
+        };
+        std::unordered_map<long long, chunk> chunks;
+        static int floorDivide(int value, int divisor)
+        {
+            return (value >= 0) ? (value / divisor) : -((-value + divisor - 1) / divisor);
+        }
+        static long long chunkKey(int chunkX, int chunkY)
+        {
+            return ((long long)chunkX << 32) | (unsigned int)chunkY;
+        }
+
+    public:
+        // Converts a world space coordinate to the cell that contains it
+        static int toCell(float worldCoordinate)
+        {
+            return (int)std::floor(worldCoordinate / cellSize);
+        }
+        void clear()
+        {
+            chunks.clear();
+        }
+        // Stores index in every cell the rectangle covers. Blocks are expected to be snapped to the grid
+        void insert(Rectangle area, int index)
+        {
+            int firstX = floorDivide((int)area.x, cellSize);
+            int firstY = floorDivide((int)area.y, cellSize);
+            int lastX = floorDivide((int)(area.x + area.width) - 1, cellSize);
+            int lastY = floorDivide((int)(area.y + area.height) - 1, cellSize);
+            for (int y = firstY; y <= lastY; y++)
+            {
+                for (int x = firstX; x <= lastX; x++)
+                {
+                    long long key = chunkKey(floorDivide(x, chunkSize), floorDivide(y, chunkSize));
+                    std::unordered_map<long long, chunk>::iterator found = chunks.find(key);
+                    if (found == chunks.end())
+                    {
+                        found = chunks.emplace(key, chunk()).first;
+                        found->second.cells.fill(-1);
+                    }
+                    found->second.cells[(y - floorDivide(y, chunkSize) * chunkSize) * chunkSize + (x - floorDivide(x, chunkSize) * chunkSize)] = index;
+                }
+            }
+        }
+        // Returns the index stored in a cell, or -1 if nothing is there
+        int getCell(int x, int y)
+        {
+            int chunkX = floorDivide(x, chunkSize);
+            int chunkY = floorDivide(y, chunkSize);
+            std::unordered_map<long long, chunk>::iterator found = chunks.find(chunkKey(chunkX, chunkY));
+            if (found == chunks.end())
+            {
+                return -1;
+            }
+            return found->second.cells[(y - chunkY * chunkSize) * chunkSize + (x - chunkX * chunkSize)];
+        }
+        // Calls visit(x, y) for every cell the segment passes through, in order from the start, until visit returns true
+        template <typename T>
+        static void traverse(Vector2 from, Vector2 to, T visit)
+        {
+            int x = toCell(from.x);
+            int y = toCell(from.y);
+            float dx = to.x - from.x;
+            float dy = to.y - from.y;
+            int stepX = (dx > 0) ? 1 : -1;
+            int stepY = (dy > 0) ? 1 : -1;
+            // Distances are fractions of the segment. next is where the next border is crossed, delta is the width of a cell
+            float deltaX = (dx != 0) ? std::fabs(cellSize / dx) : std::numeric_limits<float>::infinity();
+            float deltaY = (dy != 0) ? std::fabs(cellSize / dy) : std::numeric_limits<float>::infinity();
+            float nextX = (dx != 0) ? (((x + (dx > 0)) * cellSize) - from.x) / dx : std::numeric_limits<float>::infinity();
+            float nextY = (dy != 0) ? (((y + (dy > 0)) * cellSize) - from.y) / dy : std::numeric_limits<float>::infinity();
+            int steps = std::abs(toCell(to.x) - x) + std::abs(toCell(to.y) - y);
+            for (int i = 0; i <= steps; i++)
+            {
+                if (visit(x, y))
+                {
+                    return;
+                }
+                if (nextX < nextY)
+                {
+                    x += stepX;
+                    nextX += deltaX;
+                }
+                else
+                {
+                    y += stepY;
+                    nextY += deltaY;
+                }
+            }
+        }
+        // Appends the index of every tile in a cell overlapped by area. This never looks at what is on screen,
+        // so it is safe to call from the physics thread once the grid has been built
+        void query(Rectangle area, std::vector<int> &results)
+        {
+            int lastX = toCell(area.x + area.width);
+            int lastY = toCell(area.y + area.height);
+            for (int y = toCell(area.y); y <= lastY; y++)
+            {
+                for (int x = toCell(area.x); x <= lastX; x++)
+                {
+                    int index = getCell(x, y);
+                    if (index != -1 && (results.empty() || results.back() != index))
+                    {
+                        results.push_back(index);
+                    }
+                }
+            }
+        }
+    };
     class stationaryAnimatedBlock : public collidable
     {
     protected:
         Rectangle initialPositionOnSpriteSheet;
         Vector2 pixelsToOffsetUponUpdate;
         int maximumFrames = 2;
+        // Frames the animation is ahead of every other block of the same type
         int iteratorOffset{0};
-        int frameToDisplay{0};
+        float frameSeconds{0.1f};
+        // Only for things that are animated by something other than time, like highlighted buttons
         size_t *iterable = nullptr;
         int type;
         int rayLength{0};
@@ -265,8 +653,11 @@ namespace platformer
             return iteratorOffset;
         }
         // Computes the max distance a laser beam will travel. Gives up if it exceeds 4096 pixels
-        void computeRay(std::vector<stationaryStaticBlock> obstecules)
+        // Only meant for lasers. Walks the grid from the laser outwards and stops at the first solid tile, so the cost
+        // depends on the length of the beam rather than on the size of the level
+        void computeRay(tileGrid &grid)
         {
+            PROFILE_ZONE("stationaryAnimatedBlock::computeRay");
             Vector2 origion;
             int lowest{4096};
             int halfSpriteWidth = inGamePositionDimension.width / 2;
@@ -278,22 +669,21 @@ namespace platformer
             p2 = platformer::rotatePointAroundOtherPoint(p2, origion, rotation);
             beginOfRay = p1;
             endOfRay = p2;
-            for (size_t i = 0; i < obstecules.size(); i++)
-            {
-                Vector2 cache = obstecules.at(i).getPosition();
-                cache.x += halfSpriteWidth;
-                cache.y += halfSpriteWidth;
-                if (CheckCollisionPointLine(cache, p1, p2, halfSpriteWidth + 1))
-                {
-                    float placeholder = sqrt(pow((cache.x) - p1.x, 2) + pow((cache.y) - p1.y, 2));
-                    if (placeholder < lowest)
-                    {
-                        lowest = placeholder;
-                        endOfRay = cache;
-                    }
-                }
-            }
             rayLength = lowest;
+            grid.traverse(p1, p2, [&](int x, int y)
+                          {
+                              if (grid.getCell(x, y) == -1)
+                              {
+                                  return false;
+                              }
+                              Vector2 cache{x * (float)tileGrid::cellSize + tileGrid::cellSize / 2, y * (float)tileGrid::cellSize + tileGrid::cellSize / 2};
+                              if (!CheckCollisionPointLine(cache, p1, p2, halfSpriteWidth + 1))
+                              {
+                                  return false;
+                              }
+                              rayLength = sqrt(pow((cache.x) - p1.x, 2) + pow((cache.y) - p1.y, 2));
+                              endOfRay = cache;
+                              return true; });
         }
         void setAlpha(int ahla)
         {
@@ -321,18 +711,35 @@ namespace platformer
         {
             initialPositionOnSpriteSheet = rect;
         }
-        // (Position of spritesheet.png used as a texture) = initialPositionOnSpriteSheet + (frameToDisplay * pixelsToOffset)
+        // (Position of spritesheet.png used as a texture) = initialPositionOnSpriteSheet + (frame * pixelsToOffset)
         void setPixelsToOffset(int dx, int dy)
         {
             pixelsToOffsetUponUpdate.x = dx;
             pixelsToOffsetUponUpdate.y = dy;
         }
-        // Maximum value that frameToDisplay will reach
+        // Number of frames in the animation
         void setMaxFrames(int f)
         {
             maximumFrames = f;
         }
-        // This must be set for animation to work. The dereferenced size_t must be changing constantly.
+        int getMaxFrames()
+        {
+            return maximumFrames;
+        }
+        void setFrameSeconds(float seconds)
+        {
+            frameSeconds = seconds;
+        }
+        float getFrameSeconds()
+        {
+            return frameSeconds;
+        }
+        // The part of spritesheet.png shown for a frame
+        Rectangle getSourceRectangle(int frame)
+        {
+            return {(frame * pixelsToOffsetUponUpdate.x) + initialPositionOnSpriteSheet.x, (frame * pixelsToOffsetUponUpdate.y) + initialPositionOnSpriteSheet.y, initialPositionOnSpriteSheet.width, initialPositionOnSpriteSheet.height};
+        }
+        // Makes the frame follow the dereferenced size_t instead of time
         void setIterablePointer(size_t *ptr)
         {
             iterable = ptr;
@@ -342,24 +749,29 @@ namespace platformer
         {
             return initialPositionOnSpriteSheet;
         }
-        // Returns the currently displayed frame
-        int getFrameDisplayed()
+        // Works out the frame from the simulation clock, so any thread gets the same answer for the same time
+        int getFrameAt(double time)
         {
-            return frameToDisplay;
-        }
-        // Draws self to screen
-        void draw(Texture2D &spritesheet)
-        {
-            // Iterable must be assigned to a size_t before this can be drawn
             if (iterable != nullptr)
             {
-                frameToDisplay = ((*iterable + iteratorOffset) % maximumFrames);
-                DrawTexturePro(spritesheet, {(frameToDisplay * pixelsToOffsetUponUpdate.x) + initialPositionOnSpriteSheet.x, (frameToDisplay * pixelsToOffsetUponUpdate.y) + initialPositionOnSpriteSheet.y, initialPositionOnSpriteSheet.width, initialPositionOnSpriteSheet.height}, {inGamePositionDimension.x + inGamePositionDimension.width / 2, inGamePositionDimension.y + inGamePositionDimension.height / 2, inGamePositionDimension.width, inGamePositionDimension.height}, {inGamePositionDimension.width / 2, inGamePositionDimension.height / 2}, rotation, {255, 255, 255, (unsigned char)alpha});
+                return (*iterable + iteratorOffset) % maximumFrames;
             }
-            else
+            if (frameSeconds <= 0)
             {
-                std::cerr << "Object is missing iterable" << '\n';
+                return 0;
             }
+            return ((long long)(time / frameSeconds) + iteratorOffset) % maximumFrames;
+        }
+        // Draws self to screen. time is the simulation clock in seconds
+        // frame comes from an animationTable, so drawing never changes the block
+        void draw(renderQueue &queue, Texture2D &spritesheet, int frame)
+        {
+            queue.addSprite(AnimatedLayer, spritesheet, getSourceRectangle(frame), {inGamePositionDimension.x + inGamePositionDimension.width / 2, inGamePositionDimension.y + inGamePositionDimension.height / 2, inGamePositionDimension.width, inGamePositionDimension.height}, {inGamePositionDimension.width / 2, inGamePositionDimension.height / 2}, rotation, {255, 255, 255, (unsigned char)alpha});
+        }
+        // Draws straight away. Only for the few blocks animated through setIterablePointer, like menu buttons
+        void draw(Texture2D &spritesheet)
+        {
+            DrawTexturePro(spritesheet, getSourceRectangle(getFrameAt(0)), {inGamePositionDimension.x + inGamePositionDimension.width / 2, inGamePositionDimension.y + inGamePositionDimension.height / 2, inGamePositionDimension.width, inGamePositionDimension.height}, {inGamePositionDimension.width / 2, inGamePositionDimension.height / 2}, rotation, {255, 255, 255, (unsigned char)alpha});
         }
         stationaryAnimatedBlock()
         {
@@ -383,6 +795,487 @@ namespace platformer
             return type;
         }
     };
+    // Frames of every animated block, worked out per type. Only the render thread uses this, physics works frames out
+    // from the simulation clock with getFrameAt. update only moves each type's clip on, the frame of a block is worked
+    // out from its phase when it is asked for, so blocks that are not drawn cost nothing
+    class animationTable
+    {
+    protected:
+        struct clip
+        {
+            int frames;
+            float frameSeconds;
+            // Frame of the clip itself, every block of the type is some phase ahead of it
+            int base{0};
+        };
+        std::vector<clip> clips;
+        std::vector<int> clipOfBlock;
+        // Frames every block is ahead of its clip, already reduced to less than frames
+        std::vector<unsigned char> phaseOfBlock;
+
+    public:
+        void build(std::vector<stationaryAnimatedBlock> &animatedBlocks)
+        {
+            clips.clear();
+            clipOfBlock.assign(animatedBlocks.size(), 0);
+            phaseOfBlock.assign(animatedBlocks.size(), 0);
+            std::unordered_map<int, int> clipOfType;
+            for (size_t i = 0; i < animatedBlocks.size(); i++)
+            {
+                stationaryAnimatedBlock &block = animatedBlocks.at(i);
+                std::unordered_map<int, int>::iterator found = clipOfType.find(block.getType());
+                if (found == clipOfType.end())
+                {
+                    found = clipOfType.insert({block.getType(), (int)clips.size()}).first;
+                    clips.push_back(clip());
+                    clips.back().frames = std::min(std::max(block.getMaxFrames(), 1), 255);
+                    clips.back().frameSeconds = block.getFrameSeconds();
+                }
+                clipOfBlock[i] = found->second;
+                phaseOfBlock[i] = block.getIteratorOffset() % clips.at(found->second).frames;
+            }
+        }
+        // time is the simulation clock in seconds
+        void update(double time)
+        {
+            PROFILE_ZONE("animationTable::update");
+            for (clip &i : clips)
+            {
+                long long step = i.frameSeconds > 0 ? (long long)(time / i.frameSeconds) : 0;
+                i.base = step % i.frames;
+            }
+        }
+        int getFrame(int block)
+        {
+            const clip &of = clips[clipOfBlock[block]];
+            int frame = phaseOfBlock[block] + of.base;
+            return frame >= of.frames ? frame - of.frames : frame;
+        }
+    };
+    // Trigger volumes of every animated block with a hazard, sorted into buckets of cells when a level loads so that
+    // physics only tests the triggers near the player. Only the physics thread uses this
+    class triggerIndex
+    {
+    public:
+        static const int cellPixels = 4 * tileGrid::cellSize;
+        // Lasers hit anything within this many pixels of the beam
+        static const int laserReach = 32;
+
+    protected:
+        // One entry per trigger, in the same order as the animated blocks they belong to
+        std::vector<int> blocks;
+        std::vector<unsigned char> hazards;
+        // The inset rectangle, or for lasers the bounds of the beam and its reach
+        std::vector<Rectangle> volumes;
+        std::unordered_map<long long, std::vector<int>> buckets;
+        // Laser beams, only filled in for lasers
+        std::vector<Vector2> beamBegins;
+        std::vector<Vector2> beamEnds;
+        // Triggers that span several cells are only added once per query
+        std::vector<unsigned int> stamps;
+        unsigned int queryNumber{0};
+        std::vector<int> found;
+        // Active beams near the player, packed so they can be tested together
+        std::vector<int> packedBeams;
+        std::vector<float> packedX1;
+        std::vector<float> packedY1;
+        std::vector<float> packedX2;
+        std::vector<float> packedY2;
+        std::vector<unsigned char> packedHits;
+        // Holds the query number of the last query a beam hit in
+        std::vector<unsigned int> beamHitStamps;
+        static int toCell(float worldCoordinate)
+        {
+            return (int)std::floor(worldCoordinate / cellPixels);
+        }
+        static long long cellKey(int x, int y)
+        {
+            return ((long long)x << 32) | (unsigned int)y;
+        }
+
+    public:
+        // Must be called after every laser's ray is computed
+        void build(std::vector<stationaryAnimatedBlock> &animatedBlocks)
+        {
+            blocks.clear();
+            hazards.clear();
+            volumes.clear();
+            beamBegins.clear();
+            beamEnds.clear();
+            buckets.clear();
+            for (size_t i = 0; i < animatedBlocks.size(); i++)
+            {
+                const blockInfo &info = getBlockInfo(animatedBlocks.at(i).getType());
+                if (info.hazard == hazardBehaviours::NoHazard)
+                {
+                    continue;
+                }
+                Rectangle volume;
+                Vector2 begin = animatedBlocks.at(i).getRayBegin();
+                Vector2 end = animatedBlocks.at(i).getRayEnd();
+                if (info.hazard == hazardBehaviours::KillsPlayerWhenActive)
+                {
+                    volume = {std::fmin(begin.x, end.x) - laserReach, std::fmin(begin.y, end.y) - laserReach, std::fabs(end.x - begin.x) + 2 * laserReach, std::fabs(end.y - begin.y) + 2 * laserReach};
+                }
+                else
+                {
+                    Rectangle cache = animatedBlocks.at(i).getRectangle();
+                    volume = {cache.x + info.triggerInset, cache.y + info.triggerInset, cache.width - 2 * info.triggerInset, cache.height - 2 * info.triggerInset};
+                }
+                int trigger = blocks.size();
+                blocks.push_back(i);
+                hazards.push_back(info.hazard);
+                volumes.push_back(volume);
+                beamBegins.push_back(begin);
+                beamEnds.push_back(end);
+                for (int y = toCell(volume.y); y <= toCell(volume.y + volume.height); y++)
+                {
+                    for (int x = toCell(volume.x); x <= toCell(volume.x + volume.width); x++)
+                    {
+                        buckets[cellKey(x, y)].push_back(trigger);
+                    }
+                }
+            }
+            stamps.assign(blocks.size(), 0);
+            beamHitStamps.assign(blocks.size(), 0);
+            queryNumber = 0;
+        }
+        // Triggers in the cells that area touches, in the same order as the animated blocks
+        const std::vector<int> &query(Rectangle area)
+        {
+            found.clear();
+            queryNumber++;
+            for (int y = toCell(area.y); y <= toCell(area.y + area.height); y++)
+            {
+                for (int x = toCell(area.x); x <= toCell(area.x + area.width); x++)
+                {
+                    std::unordered_map<long long, std::vector<int>>::iterator bucket = buckets.find(cellKey(x, y));
+                    if (bucket == buckets.end())
+                    {
+                        continue;
+                    }
+                    for (int trigger : bucket->second)
+                    {
+                        if (stamps[trigger] != queryNumber)
+                        {
+                            stamps[trigger] = queryNumber;
+                            found.push_back(trigger);
+                        }
+                    }
+                }
+            }
+            std::sort(found.begin(), found.end());
+            return found;
+        }
+        // Tests point against every laser from the last query that isActive(block) returns true for, all in one batch
+        template <typename T>
+        void testBeams(const std::vector<int> &nearby, Vector2 point, T isActive)
+        {
+            packedBeams.clear();
+            packedX1.clear();
+            packedY1.clear();
+            packedX2.clear();
+            packedY2.clear();
+            for (int trigger : nearby)
+            {
+                if (hazards[trigger] == hazardBehaviours::KillsPlayerWhenActive && isActive(blocks[trigger]))
+                {
+                    packedBeams.push_back(trigger);
+                    packedX1.push_back(beamBegins[trigger].x);
+                    packedY1.push_back(beamBegins[trigger].y);
+                    packedX2.push_back(beamEnds[trigger].x);
+                    packedY2.push_back(beamEnds[trigger].y);
+                }
+            }
+            packedHits.resize(packedBeams.size());
+            collision::pointNearSegments(point, laserReach, packedX1.data(), packedY1.data(), packedX2.data(), packedY2.data(), packedBeams.size(), packedHits.data());
+            for (size_t i = 0; i < packedBeams.size(); i++)
+            {
+                if (packedHits[i])
+                {
+                    beamHitStamps[packedBeams[i]] = queryNumber;
+                }
+            }
+        }
+        // Whether testBeams found the point on this laser's beam
+        bool beamHit(int trigger)
+        {
+            return beamHitStamps[trigger] == queryNumber;
+        }
+        int getBlock(int trigger)
+        {
+            return blocks[trigger];
+        }
+        int getHazard(int trigger)
+        {
+            return hazards[trigger];
+        }
+        Rectangle getVolume(int trigger)
+        {
+            return volumes[trigger];
+        }
+        size_t size()
+        {
+            return blocks.size();
+        }
+    };
+    // Works out which blocks are on screen once per rendered frame. Blocks are sorted into chunk sized buckets when
+    // a level loads, so only the chunks that intersect the camera are ever looked at. Nothing is redone while the
+    // camera stands still
+    class visibilityCuller
+    {
+    public:
+        static const int chunkPixels = tileGrid::cellSize * tileGrid::chunkSize;
+        // Blocks just outside the screen are kept so animations and lasers next to the player stay up to date
+        static const int margin = tileGrid::cellSize;
+
+    protected:
+        struct bucket
+        {
+            std::vector<int> staticBlocks;
+            std::vector<int> animatedBlocks;
+            std::vector<int> laserBeams;
+        };
+        std::unordered_map<long long, bucket> buckets;
+        int gatheredRange[4]{0, 0, -1, -1};
+        Rectangle lastView{0, 0, -1, -1};
+        // Every block remembers the last gather it was added in, so blocks that span several chunks are only added once
+        unsigned int gatherNumber{0};
+        std::vector<unsigned int> staticStamps;
+        std::vector<unsigned int> animatedStamps;
+        std::vector<unsigned int> beamStamps;
+        std::vector<int> candidateStatic;
+        std::vector<int> candidateAnimated;
+        std::vector<int> candidateBeams;
+        std::vector<int> visibleStatic;
+        std::vector<int> visibleAnimated;
+        std::vector<int> visibleBeams;
+        static int toChunk(float worldCoordinate)
+        {
+            return (int)std::floor(worldCoordinate / chunkPixels);
+        }
+        static long long chunkKey(int chunkX, int chunkY)
+        {
+            return ((long long)chunkX << 32) | (unsigned int)chunkY;
+        }
+        static Rectangle beamBounds(stationaryAnimatedBlock &laser)
+        {
+            Vector2 begin = laser.getRayBegin();
+            Vector2 end = laser.getRayEnd();
+            // Beams are drawn 28 pixels thick
+            return {std::fmin(begin.x, end.x) - 14, std::fmin(begin.y, end.y) - 14, std::fabs(end.x - begin.x) + 28, std::fabs(end.y - begin.y) + 28};
+        }
+        template <typename function>
+        void forEachChunk(Rectangle area, function toCall)
+        {
+            int lastX = toChunk(area.x + area.width);
+            int lastY = toChunk(area.y + area.height);
+            for (int y = toChunk(area.y); y <= lastY; y++)
+            {
+                for (int x = toChunk(area.x); x <= lastX; x++)
+                {
+                    toCall(chunkKey(x, y));
+                }
+            }
+        }
+        static void gather(std::vector<int> &from, std::vector<unsigned int> &stamps, unsigned int number, std::vector<int> &into)
+        {
+            for (size_t i = 0; i < from.size(); i++)
+            {
+                if (stamps[from[i]] != number)
+                {
+                    stamps[from[i]] = number;
+                    into.push_back(from[i]);
+                }
+            }
+        }
+
+    public:
+        // Must be called after a level is loaded and before the first update. The game draws static tiles through
+        // blocks::chunkCache and passes false, so getVisibleStatic stays empty and no time is spent gathering them
+        void build(std::vector<tile> &staticBlocks, std::vector<stationaryAnimatedBlock> &animatedBlocks, bool cullStatic = true)
+        {
+            buckets.clear();
+            for (size_t i = 0; cullStatic && i < staticBlocks.size(); i++)
+            {
+                forEachChunk(staticBlocks.at(i).getRectangle(), [&](long long key)
+                             { buckets[key].staticBlocks.push_back(i); });
+            }
+            for (size_t i = 0; i < animatedBlocks.size(); i++)
+            {
+                forEachChunk(animatedBlocks.at(i).getRectangle(), [&](long long key)
+                             { buckets[key].animatedBlocks.push_back(i); });
+                if (animatedBlocks.at(i).getType() == valuesOfBlocks::LaserNoTimeOffset)
+                {
+                    forEachChunk(beamBounds(animatedBlocks.at(i)), [&](long long key)
+                                 { buckets[key].laserBeams.push_back(i); });
+                }
+            }
+            staticStamps.assign(staticBlocks.size(), 0);
+            animatedStamps.assign(animatedBlocks.size(), 0);
+            beamStamps.assign(animatedBlocks.size(), 0);
+            gatherNumber = 0;
+            gatheredRange[2] = gatheredRange[0] - 1;
+            lastView = {0, 0, -1, -1};
+            candidateStatic.clear();
+            candidateAnimated.clear();
+            candidateBeams.clear();
+            visibleStatic.clear();
+            visibleAnimated.clear();
+            visibleBeams.clear();
+        }
+        // view is the part of the world covered by the camera
+        void update(Rectangle view, std::vector<tile> &staticBlocks, std::vector<stationaryAnimatedBlock> &animatedBlocks)
+        {
+            PROFILE_ZONE("visibilityCuller::update");
+            if (view.x == lastView.x && view.y == lastView.y && view.width == lastView.width && view.height == lastView.height)
+            {
+                return;
+            }
+            lastView = view;
+            view = {view.x - margin, view.y - margin, view.width + 2 * margin, view.height + 2 * margin};
+            int range[4] = {toChunk(view.x), toChunk(view.y), toChunk(view.x + view.width), toChunk(view.y + view.height)};
+            // Only go back to the buckets when the camera crosses into a different set of chunks
+            if (range[0] != gatheredRange[0] || range[1] != gatheredRange[1] || range[2] != gatheredRange[2] || range[3] != gatheredRange[3])
+            {
+                std::copy(range, range + 4, gatheredRange);
+                gatherNumber++;
+                candidateStatic.clear();
+                candidateAnimated.clear();
+                candidateBeams.clear();
+                forEachChunk(view, [&](long long key)
+                             {
+                                 std::unordered_map<long long, bucket>::iterator found = buckets.find(key);
+                                 if (found != buckets.end())
+                                 {
+                                     gather(found->second.staticBlocks, staticStamps, gatherNumber, candidateStatic);
+                                     gather(found->second.animatedBlocks, animatedStamps, gatherNumber, candidateAnimated);
+                                     gather(found->second.laserBeams, beamStamps, gatherNumber, candidateBeams);
+                                 } });
+            }
+            visibleStatic.clear();
+            visibleAnimated.clear();
+            visibleBeams.clear();
+            for (size_t i = 0; i < candidateStatic.size(); i++)
+            {
+                if (CheckCollisionRecs(view, staticBlocks.at(candidateStatic[i]).getRectangle()))
+                {
+                    visibleStatic.push_back(candidateStatic[i]);
+                }
+            }
+            for (size_t i = 0; i < candidateAnimated.size(); i++)
+            {
+                if (CheckCollisionRecs(view, animatedBlocks.at(candidateAnimated[i]).getRectangle()))
+                {
+                    visibleAnimated.push_back(candidateAnimated[i]);
+                }
+            }
+            for (size_t i = 0; i < candidateBeams.size(); i++)
+            {
+                if (CheckCollisionRecs(view, beamBounds(animatedBlocks.at(candidateBeams[i]))))
+                {
+                    visibleBeams.push_back(candidateBeams[i]);
+                }
+            }
+        }
+        // Indexes into the static block vector
+        std::vector<int> &getVisibleStatic()
+        {
+            return visibleStatic;
+        }
+        // Indexes into the animated block vector
+        std::vector<int> &getVisibleAnimated()
+        {
+            return visibleAnimated;
+        }
+        // Indexes into the animated block vector of lasers whose beam is on screen
+        std::vector<int> &getVisibleBeams()
+        {
+            return visibleBeams;
+        }
+    };
+    // Hands the latest value from one writer thread to one reader thread without locking. Each side owns one buffer and
+    // the third holds whatever was published last, so the reader always sees a complete value and neither side waits
+    template <typename T>
+    class tripleBuffer
+    {
+    protected:
+        static const int newData = 4;
+        static const int indexMask = 3;
+        std::array<T, 3> buffers;
+        // Index of the last published buffer, with newData set until the reader takes it
+        std::atomic<int> middle{1};
+        int writing{0};
+        int reading{2};
+
+    public:
+        // The writer fills this in completely before every publish, since it may hold an old value
+        T &getWriteBuffer()
+        {
+            return buffers[writing];
+        }
+        void publish()
+        {
+            writing = middle.exchange(writing | newData, std::memory_order_acq_rel) & indexMask;
+        }
+        // Takes the newest published value if there is one. Returns false if nothing was published since the last call
+        bool update()
+        {
+            if (!(middle.load(std::memory_order_acquire) & newData))
+            {
+                return false;
+            }
+            reading = middle.exchange(reading, std::memory_order_acq_rel) & indexMask;
+            return true;
+        }
+        const T &getReadBuffer()
+        {
+            return buffers[reading];
+        }
+    };
+    // Passes values in order from one writer thread to one reader thread without locking. push fails while it is full
+    template <typename T, size_t capacity>
+    class spscQueue
+    {
+    protected:
+        std::array<T, capacity> values;
+        std::atomic<size_t> written{0};
+        std::atomic<size_t> read{0};
+
+    public:
+        bool push(const T &value)
+        {
+            size_t index = written.load(std::memory_order_relaxed);
+            if (index - read.load(std::memory_order_acquire) == capacity)
+            {
+                return false;
+            }
+            values[index % capacity] = value;
+            written.store(index + 1, std::memory_order_release);
+            return true;
+        }
+        bool pop(T &dest)
+        {
+            size_t index = read.load(std::memory_order_relaxed);
+            if (index == written.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            dest = values[index % capacity];
+            read.store(index + 1, std::memory_order_release);
+            return true;
+        }
+    };
+    // How far a box got when moved along one axis
+    struct sweepResult
+    {
+        // Fraction of the move that was made before touching a tile, 1 if nothing was in the way
+        float timeOfImpact{1};
+        // Where the moved edge of the box ends up, x or y depending on the axis
+        float position{0};
+        // Points away from the face that was touched, zero if nothing was in the way
+        Vector2 normal{0, 0};
+    };
     class npc : public stationaryAnimatedBlock
     {
     protected:
@@ -404,6 +1297,10 @@ namespace platformer
         bool reloadLevel{0};
         size_t deathCount{0};
         float chance {0.0f};
+        // Reused by every collision query so the physics thread does not allocate each tick
+        std::vector<int> nearbyTiles;
+        // Position before the last physics step, used to interpolate between steps when drawing
+        Vector2 previousPosition{0.0f, 0.0f};
     public:
         size_t getDeathCount()
         {
@@ -432,17 +1329,25 @@ namespace platformer
             playerDesiredMovement.x -= x;
             playerDesiredMovement.y -= y;
         }
-        void draw(Texture2D &spritesheet)
+        // Must be called before every physics step
+        void storePreviousPosition()
         {
-            if (iterable != nullptr)
-            {
-                frameToDisplay = (*iterable % maximumFrames);
-                DrawTexturePro(spritesheet, {(frameToDisplay * pixelsToOffsetUponUpdate.x) + initialPositionOnSpriteSheet.x, (frameToDisplay * pixelsToOffsetUponUpdate.y) + initialPositionOnSpriteSheet.y - isFacingLeft, initialPositionOnSpriteSheet.width, initialPositionOnSpriteSheet.height}, inGamePositionDimension, {0, 0}, 0, WHITE);
-            }
-            else
-            {
-                std::cerr << "Object is missing iterable" << '\n';
-            }
+            previousPosition = {inGamePositionDimension.x, inGamePositionDimension.y};
+        }
+        Vector2 getPreviousPosition()
+        {
+            return previousPosition;
+        }
+        int getFaceDirection()
+        {
+            return isFacingLeft;
+        }
+        // Only reads the sprite, so the render thread can draw a snapshot while the physics thread moves the player
+        void drawAt(renderQueue &queue, Texture2D &spritesheet, Vector2 position, int faceDirection, double time)
+        {
+            Rectangle source = getSourceRectangle(getFrameAt(time));
+            source.y -= faceDirection;
+            queue.addSprite(PlayerLayer, spritesheet, source, {position.x, position.y, inGamePositionDimension.width, inGamePositionDimension.height}, {0, 0}, 0, WHITE);
         }
         player()
         {
@@ -475,8 +1380,121 @@ namespace platformer
             // This is slightly smaller than the actual sprite because floating point approximation limitations
             return {(inGamePositionDimension.x) + (velocity.x * timeDelta * xAxisOverride), (inGamePositionDimension.y + 23) + (velocity.y * timeDelta * yAxisOverride), 63, 41};
         }
-        void doPhysicsStep(std::vector<stationaryStaticBlock> &staticBlocks, std::vector<stationaryAnimatedBlock> &animatedBlocks, float frameDelta, std::string &file, platformer::animatedText &aniText)
+        // How far box has to move in direction, 0 up, 1 down, 2 left and 3 right, to be clear of every tile. Moving out
+        // of one tile can move it into the next, so this keeps going until nothing overlaps. -1 if it is still inside a
+        // tile after 16 moves
+        float distanceToClear(Rectangle box, int direction, std::vector<tile> &staticBlocks, tileGrid &grid)
+        {
+            float moved{0};
+            for (int step = 0; step < 16; step++)
+            {
+                nearbyTiles.clear();
+                grid.query(box, nearbyTiles);
+                float furthest{0};
+                for (int i : nearbyTiles)
+                {
+                    Rectangle block = staticBlocks.at(i).getRectangle();
+                    if (!(box.x < block.x + block.width && block.x < box.x + box.width && box.y < block.y + block.height && block.y < box.y + box.height))
+                    {
+                        continue;
+                    }
+                    float needed[4] = {box.y + box.height - block.y, block.y + block.height - box.y, box.x + box.width - block.x, block.x + block.width - box.x};
+                    furthest = std::fmax(furthest, needed[direction]);
+                }
+                if (furthest == 0)
+                {
+                    return moved;
+                }
+                moved += furthest;
+                (direction < 2 ? box.y : box.x) += (direction % 2 == 0) ? -furthest : furthest;
+            }
+            return -1;
+        }
+        // Moves the player out of any tile it overlaps along whichever direction is shortest. This only happens when the
+        // player is put inside a tile, like a spawn point or checkpoint in a wall, and sweep needs the box to start clear
+        // since it lets a box move out of a tile it is already in
+        void resolveOverlaps(std::vector<tile> &staticBlocks, tileGrid &grid)
         {
+            Rectangle box = getPredictedPosition(0, 0, 0);
+            if (distanceToClear(box, 0, staticBlocks, grid) == 0)
+            {
+                return;
+            }
+            int best{-1};
+            float shortest{0};
+            // Up is tried first so that a player a little into the floor ends up standing on it
+            for (int direction = 0; direction < 4; direction++)
+            {
+                float distance = distanceToClear(box, direction, staticBlocks, grid);
+                if (distance > 0 && (best < 0 || distance < shortest))
+                {
+                    best = direction;
+                    shortest = distance;
+                }
+            }
+            if (best >= 0)
+            {
+                (best < 2 ? inGamePositionDimension.y : inGamePositionDimension.x) += (best % 2 == 0) ? -shortest : shortest;
+            }
+        }
+        // Moves box by distance along one axis and stops it at the first tile in the way, however far that is, so a long step
+        // can not pass through a tile. Tiles only touching the box from the side do not block it, and the box must not start
+        // inside a tile, see resolveOverlaps. Only the tiles the box passes over are tested, so this does not scale with level size
+        sweepResult sweep(Rectangle box, float distance, bool alongX, std::vector<tile> &staticBlocks, tileGrid &grid)
+        {
+            float start = alongX ? box.x : box.y;
+            float size = alongX ? box.width : box.height;
+            sweepResult result;
+            result.position = start + distance;
+            if (distance == 0)
+            {
+                return result;
+            }
+            Rectangle passed = box;
+            (alongX ? passed.width : passed.height) += std::fabs(distance);
+            if (distance < 0)
+            {
+                (alongX ? passed.x : passed.y) += distance;
+            }
+            nearbyTiles.clear();
+            grid.query(passed, nearbyTiles);
+            float nearestGap = std::fabs(distance);
+            for (size_t i = 0; i < nearbyTiles.size(); i++)
+            {
+                Rectangle block = staticBlocks.at(nearbyTiles[i]).getRectangle();
+                bool acrossOverlaps = alongX ? (box.y < block.y + block.height && block.y < box.y + box.height) : (box.x < block.x + block.width && block.x < box.x + box.width);
+                if (!acrossOverlaps)
+                {
+                    continue;
+                }
+                float blockStart = alongX ? block.x : block.y;
+                float blockSize = alongX ? block.width : block.height;
+                float gap = (distance > 0) ? blockStart - (start + size) : start - (blockStart + blockSize);
+                if (gap >= 0 && gap < nearestGap)
+                {
+                    nearestGap = gap;
+                    // Tiles sit on whole pixels, so the box is put exactly against the face instead of a rounding error away from it
+                    result.position = (distance > 0) ? blockStart - size : blockStart + blockSize;
+                    result.timeOfImpact = gap / std::fabs(distance);
+                    (alongX ? result.normal.x : result.normal.y) = (distance > 0) ? -1 : 1;
+                }
+            }
+            return result;
+        }
+        void respawn(platformer::animatedText &aniText, double time)
+        {
+            deathCount++;
+            aniText.setContent(TextFormat("%d Lives wasted", (int)deathCount));
+            aniText.revive(time, 5);
+            inGamePositionDimension.x = checkpoint.x;
+            inGamePositionDimension.y = checkpoint.y;
+            // Teleports are not interpolated
+            storePreviousPosition();
+        }
+        // time is the simulation clock, which decides when lasers are on. Nothing here touches the window or the disk, so this can run headless
+        void doPhysicsStep(std::vector<tile> &staticBlocks, std::vector<stationaryAnimatedBlock> &animatedBlocks, triggerIndex &triggers, tileGrid &grid, float frameDelta, double time, std::string &file, platformer::animatedText &aniText)
+        {
+            PROFILE_ZONE("player::doPhysicsStep");
             velocity.y += 1 * dragCoefficent.y * frameDelta;
             velocity.x > 0 ? velocity.x -= 1 *dragCoefficent.x *frameDelta : velocity.x += 1 * dragCoefficent.x * frameDelta;
             velocity.x += playerDesiredMovement.x;
@@ -498,118 +1516,89 @@ namespace platformer
                 velocity.y = terminalVelocity.y * -1;
             }
             playerDesiredMovement = {0, 0};
-            bool xAxisWillCollide;
-            bool yAxisWillCollide;
-            bool cWillCollide;
-            bool deadlyWillCollide;
-            int indexes[3] = {-1, -1, -1};
-            for (size_t i = 0; i < staticBlocks.size() && indexes[0] == -1; i++)
-            {
-                if (staticBlocks.at(i).getVisibility())
-                {
-                    xAxisWillCollide = CheckCollisionRecs(getPredictedPosition(frameDelta, 1, 0), staticBlocks.at(i).getRectangle());
-                    if (xAxisWillCollide)
-                    {
-                        indexes[0] = i;
-                        break;
-                    }
-                }
-            }
-            for (size_t i = 0; i < staticBlocks.size() && indexes[1] == -1; i++)
-            {
-                if (staticBlocks.at(i).getVisibility())
-                {
-                    yAxisWillCollide = CheckCollisionRecs(getPredictedPosition(frameDelta, 0, 1), staticBlocks.at(i).getRectangle());
-                    if (yAxisWillCollide)
-                    {
-                        break;
-                    }
-                }
-            }
-            for (size_t i = 0; i < staticBlocks.size() && indexes[2] == -1; i++)
-            {
-                if (staticBlocks.at(i).getVisibility())
-                {
-                    cWillCollide = CheckCollisionRecs(getPredictedPosition(frameDelta, 1, 1), staticBlocks.at(i).getRectangle());
-                    if (cWillCollide)
-                    {
-                        indexes[2] = i;
-                        break;
-                    }
-                }
-            }
-            for (int i = 0; i < animatedBlocks.size(); i++)
+            Rectangle predicted = getPredictedPosition(frameDelta, 1, 1);
+            // Only triggers around where the player is and will be this step are tested
+            Rectangle current = getRectangle();
+            Rectangle swept = {std::fmin(current.x, predicted.x), std::fmin(current.y, predicted.y), 0, 0};
+            swept.width = std::fmax(current.x + current.width, predicted.x + predicted.width) - swept.x;
+            swept.height = std::fmax(current.y + current.height, predicted.y + predicted.height) - swept.y;
+            const std::vector<int> &near = triggers.query(swept);
+            // Every active laser nearby is tested in one batch, the results are used below in block order
+            triggers.testBeams(near, {predicted.x + 32, predicted.y}, [&](int block)
+                               { return animatedBlocks.at(block).getFrameAt(time) == 1; });
+            for (int nearby : near)
             {
-                if (animatedBlocks.at(i).getType() == valuesOfBlocks::LaserNoTimeOffset && animatedBlocks.at(i).getFrameDisplayed() == 1)
+                Rectangle trigger = triggers.getVolume(nearby);
+                bool triggered{0};
+                switch (triggers.getHazard(nearby))
                 {
-                    Rectangle cache = animatedBlocks.at(i).getRectangle();
-                    deadlyWillCollide = CheckCollisionPointLine({getPredictedPosition(frameDelta, 1, 1).x + 32, getPredictedPosition(frameDelta, 1, 1).y}, animatedBlocks.at(i).getRayBegin(), animatedBlocks.at(i).getRayEnd(), 32);
-                    if (deadlyWillCollide)
+                case (hazardBehaviours::KillsPlayerWhenActive):
+                    if (triggers.beamHit(nearby))
                     {
-                        deathCount++;
-                        aniText.setContent(TextFormat("%d Lives wasted", (int)deathCount));
-                        aniText.revive(GetTime(), 5);
-                        inGamePositionDimension.x = checkpoint.x;
-                        inGamePositionDimension.y = checkpoint.y;
-                        break;
+                        respawn(aniText, time);
+                        triggered = 1;
                     }
-                }
-                else if (animatedBlocks.at(i).getType() == valuesOfBlocks::Lava)
-                {
-                    Rectangle cache = animatedBlocks.at(i).getRectangle();
-                    if (CheckCollisionRecs(getPredictedPosition(frameDelta, 1, 1), {cache.x + 4, cache.y + 4, cache.width - 8, cache.height - 8}))
+                    break;
+                case (hazardBehaviours::KillsPlayer):
+                    if (CheckCollisionRecs(predicted, trigger))
                     {
-                        deathCount++;
-                        aniText.setContent(TextFormat("%d Lives wasted", (int)deathCount));
-                        aniText.revive(GetTime(), 5);
-                        inGamePositionDimension.x = checkpoint.x;
-                        inGamePositionDimension.y = checkpoint.y;
-                        break;
+                        respawn(aniText, time);
+                        triggered = 1;
                     }
-                }
-                else if (animatedBlocks.at(i).getType() == valuesOfBlocks::Portal)
-                {
-                    Rectangle cache = animatedBlocks.at(i).getRectangle();
-                    if (CheckCollisionRecs(getPredictedPosition(frameDelta, 1, 1), {cache.x + 4, cache.y + 4, cache.width - 8, cache.height - 8}))
+                    break;
+                case (hazardBehaviours::NextLevel):
+                    if (CheckCollisionRecs(predicted, trigger))
                     {
                         int o = std::stoi(file);
                         o++;
                         file = std::to_string(o);
                         reloadLevel = 1;
-                        SaveFileText(".savedata", (char *)file.c_str());
-                        break;
+                        triggered = 1;
                     }
-                }
-                else if (animatedBlocks.at(i).getType() == valuesOfBlocks::SusJuice)
-                {
-                    Rectangle cache = animatedBlocks.at(i).getRectangle();
-                    if (CheckCollisionRecs(getPredictedPosition(frameDelta, 1, 1), {cache.x + 4, cache.y + 4, cache.width - 8, cache.height - 8}))
+                    break;
+                case (hazardBehaviours::SusJuiceEffect):
+                    if (CheckCollisionRecs(predicted, trigger))
                     {
                         chance++;
                         aniText.setContent(TextFormat("You have been artificially inseminated. Chance of pregnancy: %.2f", chance));
-                        aniText.revive(GetTime(), 5);
-                        break;
+                        aniText.revive(time, 5);
+                        triggered = 1;
                     }
-                }
-                else if (animatedBlocks.at(i).getType() == valuesOfBlocks::AccessPoint)
-                {
-                    Rectangle cache = animatedBlocks.at(i).getRectangle();
-                    if (CheckCollisionRecs(getPredictedPosition(frameDelta, 1, 1), {cache.x + 4, cache.y + 4, cache.width - 8, cache.height - 8}))
+                    break;
+                case (hazardBehaviours::SetsCheckpoint):
+                    if (CheckCollisionRecs(predicted, trigger))
                     {
                         checkpoint.x = inGamePositionDimension.x;
                         checkpoint.y = inGamePositionDimension.y - 64;
                         aniText.setContent(TextFormat("Checkpoint Set."));
-                        aniText.revive(GetTime(), 5);
-                        break;
+                        aniText.revive(time, 5);
+                        triggered = 1;
                     }
+                    break;
+                default:
+                    break;
+                }
+                if (triggered)
+                {
+                    break;
                 }
             }
-            canJump = yAxisWillCollide;
             std::abs(velocity.x) > 1.7f ? velocity.x = velocity.x : velocity.x = 0;
-            inGamePositionDimension.x += (velocity.x * frameDelta * !xAxisWillCollide);
-            inGamePositionDimension.y += (velocity.y * frameDelta * !yAxisWillCollide);
-            velocity.x = velocity.x * !xAxisWillCollide;
-            velocity.y = velocity.y * !yAxisWillCollide;
+            // x is moved first and y is swept from there, the player stops against whatever it touches
+            resolveOverlaps(staticBlocks, grid);
+            sweepResult alongX = sweep(getPredictedPosition(0, 0, 0), velocity.x * frameDelta, true, staticBlocks, grid);
+            inGamePositionDimension.x = alongX.position;
+            sweepResult alongY = sweep(getPredictedPosition(0, 0, 0), velocity.y * frameDelta, false, staticBlocks, grid);
+            inGamePositionDimension.y = alongY.position - 23;
+            if (alongX.normal.x != 0)
+            {
+                velocity.x = 0;
+            }
+            if (alongY.normal.y != 0)
+            {
+                velocity.y = 0;
+            }
+            canJump = alongY.normal.y != 0;
         }
         void jump()
         {
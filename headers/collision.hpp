@@ -0,0 +1,131 @@
+#pragma once
+#include <raylib.h>
+#include <cmath>
+#include <cstddef>
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PLATFORMER_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace platformer
+{
+    // Tests one point against many segments at once. Every version gives exactly the same answer as raylib's
+    // CheckCollisionPointLine, which is a band around the segment along its longer axis rather than a true distance,
+    // so swapping one for another never changes what the player dies to
+    namespace collision
+    {
+        // hits[i] is set to 1 if point is within threshold of the segment from (x1[i], y1[i]) to (x2[i], y2[i]) and 0 otherwise
+        typedef void (*segmentKernel)(Vector2 point, float threshold, const float *x1, const float *y1, const float *x2, const float *y2, size_t count, unsigned char *hits);
+        void pointNearSegmentsScalar(Vector2 point, float threshold, const float *x1, const float *y1, const float *x2, const float *y2, size_t count, unsigned char *hits)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                float dxc = point.x - x1[i];
+                float dyc = point.y - y1[i];
+                float dxl = x2[i] - x1[i];
+                float dyl = y2[i] - y1[i];
+                float cross = dxc * dyl - dyc * dxl;
+                bool hit = false;
+                if (std::fabs(cross) < threshold * std::fmax(std::fabs(dxl), std::fabs(dyl)))
+                {
+                    if (std::fabs(dxl) >= std::fabs(dyl))
+                    {
+                        hit = std::fmin(x1[i], x2[i]) <= point.x && point.x <= std::fmax(x1[i], x2[i]);
+                    }
+                    else
+                    {
+                        hit = std::fmin(y1[i], y2[i]) <= point.y && point.y <= std::fmax(y1[i], y2[i]);
+                    }
+                }
+                hits[i] = hit;
+            }
+        }
+#ifdef PLATFORMER_X86_KERNELS
+        // 4 segments per instruction
+        __attribute__((target("sse2"))) void pointNearSegmentsSSE(Vector2 point, float threshold, const float *x1, const float *y1, const float *x2, const float *y2, size_t count, unsigned char *hits)
+        {
+            const __m128 signBit = _mm_set1_ps(-0.0f);
+            const __m128 px = _mm_set1_ps(point.x);
+            const __m128 py = _mm_set1_ps(point.y);
+            const __m128 reach = _mm_set1_ps(threshold);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 ax = _mm_loadu_ps(x1 + i);
+                __m128 ay = _mm_loadu_ps(y1 + i);
+                __m128 bx = _mm_loadu_ps(x2 + i);
+                __m128 by = _mm_loadu_ps(y2 + i);
+                __m128 dxl = _mm_sub_ps(bx, ax);
+                __m128 dyl = _mm_sub_ps(by, ay);
+                __m128 cross = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(px, ax), dyl), _mm_mul_ps(_mm_sub_ps(py, ay), dxl));
+                __m128 absoluteDx = _mm_andnot_ps(signBit, dxl);
+                __m128 absoluteDy = _mm_andnot_ps(signBit, dyl);
+                __m128 nearLine = _mm_cmplt_ps(_mm_andnot_ps(signBit, cross), _mm_mul_ps(reach, _mm_max_ps(absoluteDx, absoluteDy)));
+                __m128 insideX = _mm_and_ps(_mm_cmple_ps(_mm_min_ps(ax, bx), px), _mm_cmple_ps(px, _mm_max_ps(ax, bx)));
+                __m128 insideY = _mm_and_ps(_mm_cmple_ps(_mm_min_ps(ay, by), py), _mm_cmple_ps(py, _mm_max_ps(ay, by)));
+                __m128 alongX = _mm_cmpge_ps(absoluteDx, absoluteDy);
+                __m128 inside = _mm_or_ps(_mm_and_ps(alongX, insideX), _mm_andnot_ps(alongX, insideY));
+                int mask = _mm_movemask_ps(_mm_and_ps(nearLine, inside));
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    hits[i + lane] = (mask >> lane) & 1;
+                }
+            }
+            pointNearSegmentsScalar(point, threshold, x1 + i, y1 + i, x2 + i, y2 + i, count - i, hits + i);
+        }
+        // 8 segments per instruction
+        __attribute__((target("avx"))) void pointNearSegmentsAVX(Vector2 point, float threshold, const float *x1, const float *y1, const float *x2, const float *y2, size_t count, unsigned char *hits)
+        {
+            const __m256 signBit = _mm256_set1_ps(-0.0f);
+            const __m256 px = _mm256_set1_ps(point.x);
+            const __m256 py = _mm256_set1_ps(point.y);
+            const __m256 reach = _mm256_set1_ps(threshold);
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256 ax = _mm256_loadu_ps(x1 + i);
+                __m256 ay = _mm256_loadu_ps(y1 + i);
+                __m256 bx = _mm256_loadu_ps(x2 + i);
+                __m256 by = _mm256_loadu_ps(y2 + i);
+                __m256 dxl = _mm256_sub_ps(bx, ax);
+                __m256 dyl = _mm256_sub_ps(by, ay);
+                __m256 cross = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(px, ax), dyl), _mm256_mul_ps(_mm256_sub_ps(py, ay), dxl));
+                __m256 absoluteDx = _mm256_andnot_ps(signBit, dxl);
+                __m256 absoluteDy = _mm256_andnot_ps(signBit, dyl);
+                __m256 nearLine = _mm256_cmp_ps(_mm256_andnot_ps(signBit, cross), _mm256_mul_ps(reach, _mm256_max_ps(absoluteDx, absoluteDy)), _CMP_LT_OQ);
+                __m256 insideX = _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(ax, bx), px, _CMP_LE_OQ), _mm256_cmp_ps(px, _mm256_max_ps(ax, bx), _CMP_LE_OQ));
+                __m256 insideY = _mm256_and_ps(_mm256_cmp_ps(_mm256_min_ps(ay, by), py, _CMP_LE_OQ), _mm256_cmp_ps(py, _mm256_max_ps(ay, by), _CMP_LE_OQ));
+                __m256 alongX = _mm256_cmp_ps(absoluteDx, absoluteDy, _CMP_GE_OQ);
+                __m256 inside = _mm256_or_ps(_mm256_and_ps(alongX, insideX), _mm256_andnot_ps(alongX, insideY));
+                int mask = _mm256_movemask_ps(_mm256_and_ps(nearLine, inside));
+                for (int lane = 0; lane < 8; lane++)
+                {
+                    hits[i + lane] = (mask >> lane) & 1;
+                }
+            }
+            pointNearSegmentsScalar(point, threshold, x1 + i, y1 + i, x2 + i, y2 + i, count - i, hits + i);
+        }
+#endif
+        // Picks the widest version the CPU supports
+        segmentKernel chooseKernel(const char *&name)
+        {
+#ifdef PLATFORMER_X86_KERNELS
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx"))
+            {
+                name = "AVX";
+                return pointNearSegmentsAVX;
+            }
+            if (__builtin_cpu_supports("sse2"))
+            {
+                name = "SSE2";
+                return pointNearSegmentsSSE;
+            }
+#endif
+            name = "scalar";
+            return pointNearSegmentsScalar;
+        }
+        const char *kernelName = nullptr;
+        const segmentKernel pointNearSegments = chooseKernel(kernelName);
+    }
+}
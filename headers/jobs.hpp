@@ -0,0 +1,271 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include "profiler.hpp"
+
+namespace platformer
+{
+    namespace jobs
+    {
+        // Counts the jobs submitted with it that have not finished yet. Must outlive them
+        struct jobGroup
+        {
+            std::atomic<int> pending{0};
+            bool isDone()
+            {
+                return pending == 0;
+            }
+        };
+        // Index of the worker running on this thread, -1 on threads that are not part of the pool
+        thread_local int currentWorker = -1;
+        // Started once at boot and kept for the whole run. Every worker has its own queue and takes the newest job from it,
+        // a worker with nothing to do steals the oldest job from another worker. Threads waiting on a group run jobs too,
+        // so with few or no workers everything still finishes on the waiting thread instead of stalling
+        class workerPool
+        {
+        protected:
+            struct job
+            {
+                std::function<void()> task;
+                jobGroup *group;
+            };
+            struct workerQueue
+            {
+                std::mutex lock;
+                std::deque<job> jobs;
+            };
+            std::vector<std::unique_ptr<workerQueue>> queues;
+            // Jobs that run until told to stop, like the physics loop. Only workers take these, so a thread that is
+            // waiting on a group never gets stuck inside one
+            workerQueue longRunning;
+            std::vector<std::thread> workers;
+            std::mutex sleepLock;
+            std::condition_variable wakeUp;
+            // Threads in wait sleep on this until a job they could run is queued or a group finishes
+            std::condition_variable waitDone;
+            std::atomic<int> waiters{0};
+            std::atomic<int> queued{0};
+            // Jobs in the worker queues, the ones a waiting thread may take
+            std::atomic<int> stealable{0};
+            std::atomic<bool> running{false};
+            std::atomic<unsigned int> nextQueue{0};
+            static bool popBack(workerQueue &queue, job &dest)
+            {
+                std::lock_guard<std::mutex> lock(queue.lock);
+                if (queue.jobs.empty())
+                {
+                    return false;
+                }
+                dest = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+                return true;
+            }
+            static bool popFront(workerQueue &queue, job &dest)
+            {
+                std::lock_guard<std::mutex> lock(queue.lock);
+                if (queue.jobs.empty())
+                {
+                    return false;
+                }
+                dest = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                return true;
+            }
+            void push(workerQueue &queue, job toPush)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(queue.lock);
+                    queue.jobs.push_back(std::move(toPush));
+                }
+                if (&queue != &longRunning)
+                {
+                    stealable++;
+                }
+                queued++;
+                // Taking the lock makes sure a worker that just found nothing to do is already waiting before it is woken
+                {
+                    std::lock_guard<std::mutex> lock(sleepLock);
+                }
+                wakeUp.notify_one();
+                if (waiters > 0 && &queue != &longRunning)
+                {
+                    waitDone.notify_all();
+                }
+            }
+            // Runs one job if there is any. Returns false if every queue was empty
+            bool runOne(int own, bool takeLongRunning)
+            {
+                job found;
+                bool hasJob = takeLongRunning && popFront(longRunning, found);
+                bool fromLongRunning = hasJob;
+                if (!hasJob && own >= 0)
+                {
+                    hasJob = popBack(*queues.at(own), found);
+                }
+                for (size_t i = 1; !hasJob && i <= queues.size(); i++)
+                {
+                    hasJob = popFront(*queues.at((own + i) % queues.size()), found);
+                }
+                if (!hasJob)
+                {
+                    return false;
+                }
+                if (!fromLongRunning)
+                {
+                    stealable--;
+                }
+                queued--;
+                found.task();
+                // The group may be gone as soon as pending reaches zero, so it is not touched after this
+                if (--found.group->pending == 0 && waiters > 0)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(sleepLock);
+                    }
+                    waitDone.notify_all();
+                }
+                return true;
+            }
+            void work(int index)
+            {
+                currentWorker = index;
+                PROFILE_THREAD("Worker " + std::to_string(index));
+                while (running)
+                {
+                    if (!runOne(index, true))
+                    {
+                        std::unique_lock<std::mutex> lock(sleepLock);
+                        wakeUp.wait(lock, [&]()
+                                    { return queued > 0 || !running; });
+                    }
+                }
+                currentWorker = -1;
+            }
+
+        public:
+            workerPool()
+            {
+                queues.push_back(std::unique_ptr<workerQueue>(new workerQueue));
+            }
+            ~workerPool()
+            {
+                stop();
+            }
+            // Must be called before anything is submitted from another thread
+            void start(unsigned int workerCount)
+            {
+                stop();
+                workerCount = std::max(1u, workerCount);
+                queues.clear();
+                for (unsigned int i = 0; i < workerCount; i++)
+                {
+                    queues.push_back(std::unique_ptr<workerQueue>(new workerQueue));
+                }
+                running = true;
+                for (unsigned int i = 0; i < workerCount; i++)
+                {
+                    workers.push_back(std::thread(&workerPool::work, this, i));
+                }
+            }
+            // Jobs that are still queued are run on the calling thread
+            void stop()
+            {
+                if (!workers.empty())
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(sleepLock);
+                        running = false;
+                    }
+                    wakeUp.notify_all();
+                    for (std::thread &i : workers)
+                    {
+                        i.join();
+                    }
+                    workers.clear();
+                }
+                while (runOne(-1, false))
+                {
+                }
+            }
+            size_t getWorkerCount()
+            {
+                return workers.size();
+            }
+            void submit(std::function<void()> task, jobGroup &group)
+            {
+                group.pending++;
+                int own = currentWorker;
+                if (own < 0 || (size_t)own >= queues.size())
+                {
+                    own = nextQueue++ % queues.size();
+                }
+                push(*queues.at(own), {std::move(task), &group});
+            }
+            // For jobs that only return once something tells them to. Each one holds a worker until it returns
+            void submitLongRunning(std::function<void()> task, jobGroup &group)
+            {
+                if (workers.empty())
+                {
+                    std::cerr << "ERROR: JOBS: A long running job was submitted before the pool was started" << '\n';
+                    return;
+                }
+                group.pending++;
+                push(longRunning, {std::move(task), &group});
+            }
+            // Runs queued jobs on this thread until everything in the group is done. Sleeps while the rest of the
+            // group is running elsewhere and there is nothing to take
+            void wait(jobGroup &group)
+            {
+                while (!group.isDone())
+                {
+                    if (!runOne(currentWorker, false))
+                    {
+                        waiters++;
+                        {
+                            std::unique_lock<std::mutex> lock(sleepLock);
+                            waitDone.wait(lock, [&]()
+                                          { return group.isDone() || stealable > 0; });
+                        }
+                        waiters--;
+                    }
+                }
+            }
+            // Calls function(begin, end) for ranges of at most grain items covering 0 to count and waits for all of them
+            template <typename T>
+            void parallelFor(size_t count, size_t grain, T function)
+            {
+                jobGroup group;
+                grain = std::max<size_t>(grain, 1);
+                for (size_t begin = grain; begin < count; begin += grain)
+                {
+                    size_t end = std::min(count, begin + grain);
+                    submit([&function, begin, end]()
+                           { function(begin, end); },
+                           group);
+                }
+                // The first range is done here so that a single range never waits on another thread
+                function(0, std::min(count, grain));
+                wait(group);
+            }
+        };
+        workerPool pool;
+        // One thread is left for the render thread, which runs jobs itself whenever it waits on them
+        void init()
+        {
+            unsigned int threads = std::thread::hardware_concurrency();
+            pool.start(threads > 1 ? threads - 1 : 1);
+        }
+        void release()
+        {
+            pool.stop();
+        }
+    }
+}
@@ -0,0 +1,600 @@
+#pragma once
+#include "classes.hpp"
+#include "jobs.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace platformer
+{
+    /*
+    Levels can be stored in three formats which are detected automatically when loading.
+
+    Text: The first line is the background color as "r g b a". Every other line is one block as "x y type rotation",
+    where x and y are in world space and rotation is in degrees.
+
+    Binary: A levelHeader, followed by header.tileCount tiles and then header.objectCount blockRecords. Both arrays are
+    sorted by chunk so a chunk's blocks are next to each other. Tiles are stored exactly as they are in memory, so the
+    game can map the file and copy them without parsing anything. All values are little endian.
+
+    Compressed: A compressedHeader, followed by header.chunkCount chunkEntries and then one DEFLATE compressed block per
+    chunk. Uncompressed, a chunk holds its tiles followed by its blockRecords, laid out like the binary format. Every
+    chunk can be decompressed on its own, so a loader can skip chunks it does not need and spread the rest over threads.
+    */
+    namespace level
+    {
+        const unsigned int binaryVersion = 1;
+        // DEFLATE never expands data by more than this, so no chunk can decompress to more than this many times its size
+        const size_t maxDeflateRatio = 1032;
+        // A single block exactly as it is written in a text level
+        struct blockRecord
+        {
+            int x;
+            int y;
+            int type;
+            int rotation;
+        };
+        struct levelHeader
+        {
+            char magic[4];
+            unsigned int version;
+            unsigned char background[4];
+            unsigned int tileCount;
+            unsigned int objectCount;
+        };
+        struct compressedHeader
+        {
+            char magic[4];
+            unsigned int version;
+            unsigned char background[4];
+            unsigned int chunkCount;
+        };
+        struct chunkEntry
+        {
+            int chunkX;
+            int chunkY;
+            // Offset from the start of the file
+            unsigned int offset;
+            unsigned int compressedSize;
+            unsigned int tileCount;
+            unsigned int objectCount;
+        };
+        static_assert(sizeof(compressedHeader) == 16, "The compressed level format relies on the layout of compressedHeader");
+        static_assert(sizeof(chunkEntry) == 24, "The compressed level format relies on the layout of chunkEntry");
+        static_assert(sizeof(tile) == 12, "The binary level format relies on the layout of platformer::tile");
+        static_assert(sizeof(levelHeader) == 20, "The binary level format relies on the layout of levelHeader");
+        // Static blocks are stored as tiles, everything else is stored as a blockRecord
+        bool isTileType(int type)
+        {
+            return isKnownBlock(type) && getBlockInfo(type).kind == blockKinds::StaticTile;
+        }
+        int floorDivide(int value, int divisor)
+        {
+            return (value >= 0) ? (value / divisor) : -((-value + divisor - 1) / divisor);
+        }
+        // x and y are in world space and rotation is in degrees, as they are written in level files
+        tile makeTile(int x, int y, int type, int rotation)
+        {
+            tile made;
+            std::memset(&made, 0, sizeof(tile));
+            made.x = floorDivide(x, 64);
+            made.y = floorDivide(y, 64);
+            made.type = type;
+            made.rotation = ((rotation / 90) % 4 + 4) % 4;
+            return made;
+        }
+        blockRecord makeRecord(tile &from)
+        {
+            return {from.x * 64, from.y * 64, from.type, from.rotation * 90};
+        }
+        // Orders cells so that everything in a chunk is contiguous
+        bool isBeforeInChunkOrder(int lhsX, int lhsY, int rhsX, int rhsY)
+        {
+            int lhsChunkX = floorDivide(lhsX, tileGrid::chunkSize);
+            int lhsChunkY = floorDivide(lhsY, tileGrid::chunkSize);
+            int rhsChunkX = floorDivide(rhsX, tileGrid::chunkSize);
+            int rhsChunkY = floorDivide(rhsY, tileGrid::chunkSize);
+            if (lhsChunkY != rhsChunkY)
+            {
+                return lhsChunkY < rhsChunkY;
+            }
+            if (lhsChunkX != rhsChunkX)
+            {
+                return lhsChunkX < rhsChunkX;
+            }
+            return (lhsY < rhsY) || (lhsY == rhsY && lhsX < rhsX);
+        }
+        void sortByChunk(std::vector<tile> &tiles, std::vector<blockRecord> &objects)
+        {
+            std::stable_sort(tiles.begin(), tiles.end(), [](const tile &lhs, const tile &rhs)
+                             { return isBeforeInChunkOrder(lhs.x, lhs.y, rhs.x, rhs.y); });
+            std::stable_sort(objects.begin(), objects.end(), [](const blockRecord &lhs, const blockRecord &rhs)
+                             { return isBeforeInChunkOrder(floorDivide(lhs.x, 64), floorDivide(lhs.y, 64), floorDivide(rhs.x, 64), floorDivide(rhs.y, 64)); });
+        }
+        // Parses a text level. Lines that do not hold exactly four numbers are skipped, like they always have been
+        bool parseText(const char *text, size_t length, Color &background, std::vector<blockRecord> &records)
+        {
+            const char *position = text;
+            const char *end = text + length;
+            bool readBackground = false;
+            while (position < end)
+            {
+                const char *lineEnd = (const char *)std::memchr(position, '\n', end - position);
+                if (lineEnd == nullptr)
+                {
+                    lineEnd = end;
+                }
+                long values[5];
+                int count = 0;
+                const char *cursor = position;
+                while (cursor < lineEnd && count < 5)
+                {
+                    while (cursor < lineEnd && (*cursor == ' ' || *cursor == '\r' || *cursor == '\t'))
+                    {
+                        cursor++;
+                    }
+                    if (cursor >= lineEnd)
+                    {
+                        break;
+                    }
+                    char *numberEnd;
+                    values[count] = std::strtol(cursor, &numberEnd, 10);
+                    if (numberEnd == cursor)
+                    {
+                        // Not a number. Throw the whole line away
+                        count = 0;
+                        break;
+                    }
+                    count++;
+                    cursor = numberEnd;
+                }
+                if (!readBackground)
+                {
+                    if (count < 4)
+                    {
+                        return false;
+                    }
+                    background = {(unsigned char)values[0], (unsigned char)values[1], (unsigned char)values[2], (unsigned char)values[3]};
+                    readBackground = true;
+                }
+                else if (count == 4)
+                {
+                    records.push_back({(int)values[0], (int)values[1], (int)values[2], (int)values[3]});
+                }
+                position = lineEnd + 1;
+            }
+            return readBackground;
+        }
+        // Read only view of a level. Binary levels are mapped straight from disk, text levels are parsed into memory
+        class levelData
+        {
+        protected:
+            std::vector<tile> ownedTiles;
+            std::vector<blockRecord> ownedObjects;
+            std::vector<char> ownedFile;
+            void *mapping = nullptr;
+            size_t mappingSize{0};
+            const tile *tiles = nullptr;
+            size_t tileCount{0};
+            const blockRecord *objects = nullptr;
+            size_t objectCount{0};
+            Color background{0, 0, 0, 255};
+            bool useBinary(const char *data, size_t size)
+            {
+                if (size < sizeof(levelHeader))
+                {
+                    return false;
+                }
+                levelHeader header;
+                std::memcpy(&header, data, sizeof(levelHeader));
+                if (header.version != binaryVersion || (sizeof(levelHeader) + header.tileCount * sizeof(tile) + header.objectCount * sizeof(blockRecord)) > size)
+                {
+                    std::cerr << "ERROR: LEVEL: Unsupported or truncated binary level" << '\n';
+                    return false;
+                }
+                background = {header.background[0], header.background[1], header.background[2], header.background[3]};
+                tiles = (const tile *)(data + sizeof(levelHeader));
+                tileCount = header.tileCount;
+                objects = (const blockRecord *)(data + sizeof(levelHeader) + header.tileCount * sizeof(tile));
+                objectCount = header.objectCount;
+                return true;
+            }
+            bool useCompressed(const char *data, size_t size, std::function<bool(int, int)> &isChunkWanted)
+            {
+                compressedHeader header;
+                std::memcpy(&header, data, sizeof(compressedHeader));
+                if (header.version != binaryVersion || sizeof(compressedHeader) + (size_t)header.chunkCount * sizeof(chunkEntry) > size)
+                {
+                    std::cerr << "ERROR: LEVEL: Unsupported or truncated compressed level" << '\n';
+                    return false;
+                }
+                background = {header.background[0], header.background[1], header.background[2], header.background[3]};
+                // Work out where every wanted chunk goes beforehand, so the chunks can be decompressed in any order
+                std::vector<chunkEntry> wanted;
+                std::vector<size_t> tileOffsets;
+                std::vector<size_t> objectOffsets;
+                size_t totalTiles = 0;
+                size_t totalObjects = 0;
+                size_t tableEnd = sizeof(compressedHeader) + (size_t)header.chunkCount * sizeof(chunkEntry);
+                for (unsigned int i = 0; i < header.chunkCount; i++)
+                {
+                    chunkEntry entry;
+                    std::memcpy(&entry, data + sizeof(compressedHeader) + i * sizeof(chunkEntry), sizeof(chunkEntry));
+                    if (entry.offset < tableEnd || (size_t)entry.offset + entry.compressedSize > size)
+                    {
+                        std::cerr << "ERROR: LEVEL: Truncated compressed level" << '\n';
+                        return false;
+                    }
+                    // The counts decide how much is allocated before anything is decompressed, so they must describe
+                    // a payload the compressed bytes could actually hold. The exact length is checked once decompressed
+                    size_t payloadSize = (size_t)entry.tileCount * sizeof(tile) + (size_t)entry.objectCount * sizeof(blockRecord);
+                    if (payloadSize > (size_t)entry.compressedSize * maxDeflateRatio)
+                    {
+                        std::cerr << "ERROR: LEVEL: Chunk " << entry.chunkX << ' ' << entry.chunkY << " has more blocks than it can hold" << '\n';
+                        return false;
+                    }
+                    if (!isChunkWanted || isChunkWanted(entry.chunkX, entry.chunkY))
+                    {
+                        wanted.push_back(entry);
+                        tileOffsets.push_back(totalTiles);
+                        objectOffsets.push_back(totalObjects);
+                        totalTiles += entry.tileCount;
+                        totalObjects += entry.objectCount;
+                    }
+                }
+                ownedTiles.resize(totalTiles);
+                ownedObjects.resize(totalObjects);
+                std::atomic<bool> failed{false};
+                jobs::pool.parallelFor(wanted.size(), 8, [&](size_t begin, size_t end)
+                                       {
+                                           for (size_t i = begin; i < end; i++)
+                                           {
+                                               int decompressedSize = 0;
+                                               unsigned char *decompressed = DecompressData((const unsigned char *)data + wanted[i].offset, wanted[i].compressedSize, &decompressedSize);
+                                               if (decompressed == nullptr || (size_t)decompressedSize != wanted[i].tileCount * sizeof(tile) + wanted[i].objectCount * sizeof(blockRecord))
+                                               {
+                                                   failed = true;
+                                               }
+                                               else
+                                               {
+                                                   std::memcpy(ownedTiles.data() + tileOffsets[i], decompressed, wanted[i].tileCount * sizeof(tile));
+                                                   std::memcpy(ownedObjects.data() + objectOffsets[i], decompressed + wanted[i].tileCount * sizeof(tile), wanted[i].objectCount * sizeof(blockRecord));
+                                               }
+                                               if (decompressed != nullptr)
+                                               {
+                                                   MemFree(decompressed);
+                                               }
+                                           } });
+                if (failed)
+                {
+                    std::cerr << "ERROR: LEVEL: A chunk failed to decompress" << '\n';
+                    return false;
+                }
+                tiles = ownedTiles.data();
+                tileCount = ownedTiles.size();
+                objects = ownedObjects.data();
+                objectCount = ownedObjects.size();
+                return true;
+            }
+            void useRecords(std::vector<blockRecord> &records)
+            {
+                for (blockRecord &i : records)
+                {
+                    if (isTileType(i.type))
+                    {
+                        ownedTiles.push_back(makeTile(i.x, i.y, i.type, i.rotation));
+                    }
+                    else
+                    {
+                        ownedObjects.push_back(i);
+                    }
+                }
+                sortByChunk(ownedTiles, ownedObjects);
+                tiles = ownedTiles.data();
+                tileCount = ownedTiles.size();
+                objects = ownedObjects.data();
+                objectCount = ownedObjects.size();
+            }
+
+        public:
+            static bool isBinary(const char *data, size_t size)
+            {
+                return size >= 4 && std::memcmp(data, "PLVL", 4) == 0;
+            }
+            static bool isCompressed(const char *data, size_t size)
+            {
+                return size >= sizeof(compressedHeader) && std::memcmp(data, "PLVZ", 4) == 0;
+            }
+            // Returns false if the file is missing or malformed
+            bool open(const char *filename)
+            {
+                std::function<bool(int, int)> everyChunk;
+                return open(filename, everyChunk);
+            }
+            // Compressed levels only decompress the chunks isChunkWanted returns true for. Other formats always load everything
+            bool open(const char *filename, std::function<bool(int, int)> isChunkWanted)
+            {
+                close();
+                const char *data = nullptr;
+                size_t size = 0;
+#if defined(__unix__) || defined(__APPLE__)
+                int descriptor = ::open(filename, O_RDONLY);
+                if (descriptor == -1)
+                {
+                    return false;
+                }
+                struct stat info;
+                if (fstat(descriptor, &info) == 0 && info.st_size > 0)
+                {
+                    mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                    if (mapping == MAP_FAILED)
+                    {
+                        mapping = nullptr;
+                    }
+                    else
+                    {
+                        mappingSize = info.st_size;
+                        data = (const char *)mapping;
+                        size = mappingSize;
+                    }
+                }
+                ::close(descriptor);
+#else
+                std::ifstream source(filename, std::ios::in | std::ios::binary);
+                if (!source.is_open())
+                {
+                    return false;
+                }
+                ownedFile.assign(std::istreambuf_iterator<char>(source), std::istreambuf_iterator<char>());
+                data = ownedFile.data();
+                size = ownedFile.size();
+#endif
+                if (data == nullptr)
+                {
+                    return false;
+                }
+                if (isBinary(data, size))
+                {
+                    if (!useBinary(data, size))
+                    {
+                        close();
+                        return false;
+                    }
+                    return true;
+                }
+                std::vector<blockRecord> records;
+                bool parsed;
+                if (isCompressed(data, size))
+                {
+                    parsed = useCompressed(data, size, isChunkWanted);
+                }
+                else
+                {
+                    parsed = parseText(data, size, background, records);
+                }
+                // Text and compressed levels are fully copied out, so the mapping is not needed anymore
+#if defined(__unix__) || defined(__APPLE__)
+                munmap(mapping, mappingSize);
+                mapping = nullptr;
+                mappingSize = 0;
+#endif
+                ownedFile.clear();
+                if (!parsed)
+                {
+                    close();
+                    return false;
+                }
+                if (tiles == nullptr)
+                {
+                    useRecords(records);
+                }
+                return true;
+            }
+            void close()
+            {
+#if defined(__unix__) || defined(__APPLE__)
+                if (mapping != nullptr)
+                {
+                    munmap(mapping, mappingSize);
+                }
+#endif
+                mapping = nullptr;
+                mappingSize = 0;
+                ownedTiles.clear();
+                ownedObjects.clear();
+                ownedFile.clear();
+                tiles = nullptr;
+                tileCount = 0;
+                objects = nullptr;
+                objectCount = 0;
+            }
+            Color getBackground()
+            {
+                return background;
+            }
+            // Static blocks, sorted by chunk
+            const tile *getTiles()
+            {
+                return tiles;
+            }
+            size_t getTileCount()
+            {
+                return tileCount;
+            }
+            // Every block that is not a tile, sorted by chunk
+            const blockRecord *getObjects()
+            {
+                return objects;
+            }
+            size_t getObjectCount()
+            {
+                return objectCount;
+            }
+            // Every block in the level as it would be written in a text level
+            void getRecords(std::vector<blockRecord> &records)
+            {
+                for (size_t i = 0; i < tileCount; i++)
+                {
+                    tile cache = tiles[i];
+                    records.push_back(makeRecord(cache));
+                }
+                records.insert(records.end(), objects, objects + objectCount);
+            }
+            levelData()
+            {
+            }
+            levelData(const levelData &) = delete;
+            levelData &operator=(const levelData &) = delete;
+            ~levelData()
+            {
+                close();
+            }
+        };
+        bool writeText(const char *filename, Color background, std::vector<blockRecord> &records)
+        {
+            std::ofstream output(filename, std::ios::out | std::ios::trunc);
+            if (!output.is_open())
+            {
+                return false;
+            }
+            output << (int)background.r << ' ' << (int)background.g << ' ' << (int)background.b << ' ' << (int)background.a << '\n';
+            for (blockRecord &i : records)
+            {
+                output << i.x << ' ' << i.y << ' ' << i.type << ' ' << i.rotation << '\n';
+            }
+            output.close();
+            return !output.fail();
+        }
+        bool writeBinary(const char *filename, Color background, std::vector<blockRecord> &records)
+        {
+            std::vector<tile> tiles;
+            std::vector<blockRecord> objects;
+            for (blockRecord &i : records)
+            {
+                if (isTileType(i.type))
+                {
+                    tiles.push_back(makeTile(i.x, i.y, i.type, i.rotation));
+                }
+                else
+                {
+                    objects.push_back(i);
+                }
+            }
+            sortByChunk(tiles, objects);
+            levelHeader header;
+            std::memcpy(header.magic, "PLVL", 4);
+            header.version = binaryVersion;
+            header.background[0] = background.r;
+            header.background[1] = background.g;
+            header.background[2] = background.b;
+            header.background[3] = background.a;
+            header.tileCount = tiles.size();
+            header.objectCount = objects.size();
+            std::ofstream output(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!output.is_open())
+            {
+                return false;
+            }
+            output.write((const char *)&header, sizeof(levelHeader));
+            output.write((const char *)tiles.data(), tiles.size() * sizeof(tile));
+            output.write((const char *)objects.data(), objects.size() * sizeof(blockRecord));
+            output.close();
+            return !output.fail();
+        }
+        bool writeCompressed(const char *filename, Color background, std::vector<blockRecord> &records)
+        {
+            std::vector<tile> tiles;
+            std::vector<blockRecord> objects;
+            for (blockRecord &i : records)
+            {
+                if (isTileType(i.type))
+                {
+                    tiles.push_back(makeTile(i.x, i.y, i.type, i.rotation));
+                }
+                else
+                {
+                    objects.push_back(i);
+                }
+            }
+            sortByChunk(tiles, objects);
+            // Both arrays are in chunk order, so every chunk is a run in each of them
+            std::vector<chunkEntry> entries;
+            std::vector<std::string> payloads;
+            size_t nextTile = 0;
+            size_t nextObject = 0;
+            while (nextTile < tiles.size() || nextObject < objects.size())
+            {
+                int chunkX;
+                int chunkY;
+                bool tileIsFirst = nextObject >= objects.size() || (nextTile < tiles.size() && isBeforeInChunkOrder(tiles[nextTile].x, tiles[nextTile].y, floorDivide(objects[nextObject].x, 64), floorDivide(objects[nextObject].y, 64)));
+                if (tileIsFirst)
+                {
+                    chunkX = floorDivide(tiles[nextTile].x, tileGrid::chunkSize);
+                    chunkY = floorDivide(tiles[nextTile].y, tileGrid::chunkSize);
+                }
+                else
+                {
+                    chunkX = floorDivide(floorDivide(objects[nextObject].x, 64), tileGrid::chunkSize);
+                    chunkY = floorDivide(floorDivide(objects[nextObject].y, 64), tileGrid::chunkSize);
+                }
+                chunkEntry entry{chunkX, chunkY, 0, 0, 0, 0};
+                std::string payload;
+                while (nextTile < tiles.size() && floorDivide(tiles[nextTile].x, tileGrid::chunkSize) == chunkX && floorDivide(tiles[nextTile].y, tileGrid::chunkSize) == chunkY)
+                {
+                    payload.append((const char *)&tiles[nextTile], sizeof(tile));
+                    entry.tileCount++;
+                    nextTile++;
+                }
+                while (nextObject < objects.size() && floorDivide(floorDivide(objects[nextObject].x, 64), tileGrid::chunkSize) == chunkX && floorDivide(floorDivide(objects[nextObject].y, 64), tileGrid::chunkSize) == chunkY)
+                {
+                    payload.append((const char *)&objects[nextObject], sizeof(blockRecord));
+                    entry.objectCount++;
+                    nextObject++;
+                }
+                int compressedSize = 0;
+                unsigned char *compressed = CompressData((const unsigned char *)payload.data(), payload.size(), &compressedSize);
+                if (compressed == nullptr)
+                {
+                    return false;
+                }
+                entry.compressedSize = compressedSize;
+                payloads.push_back(std::string((const char *)compressed, compressedSize));
+                MemFree(compressed);
+                entries.push_back(entry);
+            }
+            compressedHeader header;
+            std::memcpy(header.magic, "PLVZ", 4);
+            header.version = binaryVersion;
+            header.background[0] = background.r;
+            header.background[1] = background.g;
+            header.background[2] = background.b;
+            header.background[3] = background.a;
+            header.chunkCount = entries.size();
+            size_t offset = sizeof(compressedHeader) + entries.size() * sizeof(chunkEntry);
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                entries[i].offset = offset;
+                offset += entries[i].compressedSize;
+            }
+            std::ofstream output(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!output.is_open())
+            {
+                return false;
+            }
+            output.write((const char *)&header, sizeof(compressedHeader));
+            output.write((const char *)entries.data(), entries.size() * sizeof(chunkEntry));
+            for (std::string &i : payloads)
+            {
+                output.write(i.data(), i.size());
+            }
+            output.close();
+            return !output.fail();
+        }
+    }
+}
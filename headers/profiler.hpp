@@ -0,0 +1,182 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// PROFILE_ZONE times the rest of the scope it is in, PROFILE_THREAD names the calling thread in the trace. Zone names
+// must be string literals since only the pointer is kept. Zones are only recorded in builds made with
+// -DPLATFORMER_PROFILE (make profile), everywhere else both macros expand to nothing
+#ifdef PLATFORMER_PROFILE
+#define PROFILE_CONCATENATE_INNER(a, b) a##b
+#define PROFILE_CONCATENATE(a, b) PROFILE_CONCATENATE_INNER(a, b)
+#define PROFILE_ZONE(name) platformer::profiler::zone PROFILE_CONCATENATE(profiledZone, __LINE__)(name)
+#define PROFILE_THREAD(name) platformer::profiler::nameThread(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD(name)
+#endif
+
+namespace platformer
+{
+    // Records when each zone started and ended on every thread and writes them out in the Chrome trace format,
+    // which chrome://tracing and Perfetto can open
+    namespace profiler
+    {
+#ifdef PLATFORMER_PROFILE
+        const bool compiledIn = true;
+#else
+        const bool compiledIn = false;
+#endif
+        struct zoneRecord
+        {
+            const char *name;
+            // Nanoseconds since the program started
+            long long begin;
+            long long end;
+        };
+        // Only the thread that owns a ring writes to it and a record is never changed after written has moved past it
+        // until the ring wraps around, so a trace can be written while every thread keeps recording without any locks
+        struct threadRing
+        {
+            static const size_t capacity = 1 << 16;
+            std::vector<zoneRecord> records;
+            std::atomic<unsigned long long> written{0};
+            // Value of written when the current recording started, anything before it is left out of the trace
+            std::atomic<unsigned long long> firstRecorded{0};
+            // Guarded by ringsLock
+            std::string name;
+            int id;
+        };
+        std::atomic<bool> recording{false};
+        const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        // Only taken when a thread records for the first time, is named or when recording starts and stops
+        std::mutex ringsLock;
+        std::vector<std::unique_ptr<threadRing>> rings;
+        thread_local threadRing *ownRing = nullptr;
+        long long now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+        }
+        threadRing &getRing()
+        {
+            if (ownRing == nullptr)
+            {
+                std::lock_guard<std::mutex> lock(ringsLock);
+                rings.push_back(std::unique_ptr<threadRing>(new threadRing));
+                ownRing = rings.back().get();
+                ownRing->records.resize(threadRing::capacity);
+                ownRing->id = rings.size();
+                ownRing->name = "Thread " + std::to_string(ownRing->id);
+            }
+            return *ownRing;
+        }
+        void nameThread(const std::string &name)
+        {
+            threadRing &ring = getRing();
+            std::lock_guard<std::mutex> lock(ringsLock);
+            ring.name = name;
+        }
+        void record(const char *name, long long begin, long long end)
+        {
+            threadRing &ring = getRing();
+            unsigned long long index = ring.written.load(std::memory_order_relaxed);
+            ring.records[index % threadRing::capacity] = {name, begin, end};
+            ring.written.store(index + 1, std::memory_order_release);
+        }
+        // Whether a zone is recorded is decided when it starts, so zones still open when recording stops are left out
+        class zone
+        {
+        protected:
+            const char *name;
+            long long begin{0};
+            bool active{0};
+
+        public:
+            zone(const char *zoneName)
+            {
+                name = zoneName;
+                active = recording.load(std::memory_order_relaxed);
+                if (active)
+                {
+                    begin = now();
+                }
+            }
+            ~zone()
+            {
+                if (active)
+                {
+                    record(name, begin, now());
+                }
+            }
+        };
+        void start()
+        {
+            std::lock_guard<std::mutex> lock(ringsLock);
+            for (std::unique_ptr<threadRing> &i : rings)
+            {
+                i->firstRecorded = i->written.load(std::memory_order_acquire);
+            }
+            recording = true;
+        }
+        // Stops recording and writes every zone recorded since start to filename. Returns false if the file could not be written
+        bool stop(const std::string &filename, size_t &zonesWritten)
+        {
+            recording = false;
+            zonesWritten = 0;
+            std::ofstream output(filename);
+            if (!output)
+            {
+                std::cerr << "ERROR: PROFILER: Could not write " << filename << '\n';
+                return false;
+            }
+            output << std::fixed << std::setprecision(3);
+            output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            size_t dropped{0};
+            bool first{1};
+            std::vector<zoneRecord> copied;
+            std::lock_guard<std::mutex> lock(ringsLock);
+            for (std::unique_ptr<threadRing> &ring : rings)
+            {
+                unsigned long long end = ring->written.load(std::memory_order_acquire);
+                unsigned long long begin = ring->firstRecorded;
+                if (end - begin > threadRing::capacity)
+                {
+                    dropped += end - begin - threadRing::capacity;
+                    begin = end - threadRing::capacity;
+                }
+                copied.clear();
+                for (unsigned long long i = begin; i < end; i++)
+                {
+                    copied.push_back(ring->records[i % threadRing::capacity]);
+                }
+                // Zones that were open when recording stopped may have wrapped around over the oldest copies
+                unsigned long long overwritten = ring->written.load(std::memory_order_acquire);
+                size_t skip = 0;
+                if (overwritten - begin > threadRing::capacity)
+                {
+                    skip = overwritten - begin - threadRing::capacity;
+                    dropped += skip;
+                }
+                output << (first ? "" : ",") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->id << ",\"args\":{\"name\":\"" << ring->name << "\"}}";
+                first = 0;
+                for (size_t i = skip; i < copied.size(); i++)
+                {
+                    output << ",{\"name\":\"" << copied[i].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->id << ",\"ts\":" << copied[i].begin / 1000.0 << ",\"dur\":" << (copied[i].end - copied[i].begin) / 1000.0 << '}';
+                    zonesWritten++;
+                }
+            }
+            output << "]}" << '\n';
+            if (dropped > 0)
+            {
+                std::cerr << "WARN: PROFILER: " << dropped << " zones were overwritten before they could be written out" << '\n';
+            }
+            return (bool)output;
+        }
+    }
+}
@@ -5,18 +5,197 @@ namespace platformer
 {
     namespace settings
     {
-        std::vector<int> activeKeypresses(5, 0);
+        platformer::blocks::inputState activeKeypresses{};
+        // Memory the baked chunks of static tiles may use, see blocks::chunkCache
+        size_t chunkCacheMegabytes{64};
     }
     namespace music
     {
         struct song
         {
-            Music music;
+            std::string path;
             std::string Title;
         };
+        // A song is streamed from its bytes in memory, which raylib keeps reading from until the stream is unloaded
+        struct openSong
+        {
+            Music music{};
+            std::vector<unsigned char> bytes;
+        };
+        enum audioCommands
+        {
+            SkipSong,
+            StopAudio
+        };
+        // Only the names of the files are read at startup and never change after that. Everything else about the music
+        // belongs to the audio thread, which keeps the stream fed however long a frame takes. The render thread only
+        // sends it commands and is told when a new song starts
         std::vector<song> playlist;
-        Music *activeMusic = nullptr;
-        int currentlyPlayingIndex{0};
+        std::atomic<int> currentlyPlayingIndex{0};
+        // Changes every time the audio thread starts the next song
+        std::atomic<unsigned int> songSequence{0};
+        unsigned int announcedSequence{0};
+        spscQueue<int, 16> commands;
+        // Its own thread instead of a long running job, a job would hold a worker for the whole session
+        std::thread audioThread;
+        // How often the stream is refilled, far shorter than the stream's buffer
+        constexpr std::chrono::milliseconds audioTick{5};
+        // How often the stream is checked in the last two ticks of a song, so the next one starts soon after it ends
+        constexpr std::chrono::milliseconds finalTick{1};
+        // How long before the end of a song the next one is read and opened, so there are at most two open at once
+        constexpr float preloadSeconds = 10.0f;
+        // At most this much of the next song is read per tick, so a read never takes long enough for the stream to run dry.
+        // Even a large song is read in a second or two, long before preloadSeconds are up
+        constexpr size_t readChunkBytes = 64 * 1024;
+        // Everything from here on is only touched by the audio thread
+        openSong playing;
+        openSong upcoming;
+        // -1 until the next song is being read
+        int nextIndex{-1};
+        // Open while the next song is being read into upcoming.bytes
+        std::ifstream reading;
+        size_t bytesRead{0};
+        // The next song is looked for after this one. It is the song that is playing unless the ones after it could not be opened
+        int searchFrom{0};
+        // Songs in a row that could not be opened. Once every song has failed nothing more is tried until the next skip
+        size_t failedOpens{0};
+        void readSong(const std::string &path, std::vector<unsigned char> &dest)
+        {
+            std::ifstream input(path, std::ios::in | std::ios::binary | std::ios::ate);
+            dest.resize(std::max<std::streamoff>((std::streamoff)input.tellg(), 0));
+            input.seekg(0);
+            if (!input.read((char *)dest.data(), dest.size()) || dest.empty())
+            {
+                std::cerr << "ERROR: MUSIC: Could not read " << path << '\n';
+                dest.clear();
+            }
+        }
+        void open(openSong &toOpen, int index)
+        {
+            toOpen.music = LoadMusicStreamFromMemory(GetFileExtension(playlist.at(index).path.c_str()), toOpen.bytes.data(), toOpen.bytes.size());
+            toOpen.music.looping = 0;
+        }
+        // The next song could not be read or opened, the one after it is tried next while the current song keeps playing
+        void skipUnreadable()
+        {
+            reading.close();
+            upcoming.bytes = std::vector<unsigned char>();
+            searchFrom = nextIndex;
+            nextIndex = -1;
+            failedOpens++;
+        }
+        // Reads the next song a chunk per call and opens it once every byte is in. It is read here on the audio thread
+        // rather than on the worker pool, where physics may hold the only worker for the whole level
+        void openNext()
+        {
+            if (upcoming.music.ctxData != nullptr || failedOpens >= playlist.size())
+            {
+                return;
+            }
+            if (!reading.is_open())
+            {
+                nextIndex = (searchFrom + 1) % playlist.size();
+                reading.open(playlist.at(nextIndex).path, std::ios::in | std::ios::binary | std::ios::ate);
+                std::streamoff size = reading ? (std::streamoff)reading.tellg() : 0;
+                reading.seekg(0);
+                if (!reading || size <= 0)
+                {
+                    std::cerr << "ERROR: MUSIC: Could not read " << playlist.at(nextIndex).path << '\n';
+                    skipUnreadable();
+                    return;
+                }
+                upcoming.bytes.resize(size);
+                bytesRead = 0;
+            }
+            size_t toRead = std::min(readChunkBytes, upcoming.bytes.size() - bytesRead);
+            if (!reading.read((char *)upcoming.bytes.data() + bytesRead, toRead))
+            {
+                std::cerr << "ERROR: MUSIC: Could not read " << playlist.at(nextIndex).path << '\n';
+                skipUnreadable();
+                return;
+            }
+            bytesRead += toRead;
+            if (bytesRead < upcoming.bytes.size())
+            {
+                return;
+            }
+            reading.close();
+            open(upcoming, nextIndex);
+            if (upcoming.music.ctxData == nullptr)
+            {
+                skipUnreadable();
+                return;
+            }
+            failedOpens = 0;
+        }
+        // Starts the next song if it is open and unloads the old one. raylib can not queue one stream behind another, so
+        // this is called once the old song has finished and the next one starts within a finalTick of it, not on the same sample
+        bool playNext()
+        {
+            if (upcoming.music.ctxData == nullptr)
+            {
+                return false;
+            }
+            PlayMusicStream(upcoming.music);
+            UpdateMusicStream(upcoming.music);
+            StopMusicStream(playing.music);
+            UnloadMusicStream(playing.music);
+            // Moving the bytes keeps them where the stream reads them from
+            playing = std::move(upcoming);
+            upcoming = openSong();
+            currentlyPlayingIndex = nextIndex;
+            searchFrom = nextIndex;
+            nextIndex = -1;
+            songSequence++;
+            return true;
+        }
+        void stream()
+        {
+            PROFILE_THREAD("Audio");
+            PlayMusicStream(playing.music);
+            bool skipping{0};
+            while (true)
+            {
+                int command;
+                bool stopping{0};
+                while (commands.pop(command))
+                {
+                    if (command == SkipSong)
+                    {
+                        skipping = 1;
+                        failedOpens = 0;
+                    }
+                    stopping = stopping || command == StopAudio;
+                }
+                if (stopping)
+                {
+                    break;
+                }
+                float remaining;
+                {
+                    PROFILE_ZONE("Audio tick");
+                    UpdateMusicStream(playing.music);
+                    remaining = GetMusicTimeLength(playing.music) - GetMusicTimePlayed(playing.music);
+                    if (remaining < preloadSeconds || skipping)
+                    {
+                        openNext();
+                    }
+                    // A song is only cut short when skipped, otherwise the next one waits until raylib reports it has finished
+                    if ((skipping || !IsMusicStreamPlaying(playing.music)) && playNext())
+                    {
+                        skipping = 0;
+                    }
+                }
+                std::this_thread::sleep_for(remaining < 2 * std::chrono::duration<float>(audioTick).count() ? finalTick : audioTick);
+            }
+            StopMusicStream(playing.music);
+            UnloadMusicStream(playing.music);
+            UnloadMusicStream(upcoming.music);
+            reading.close();
+            playing = openSong();
+            upcoming = openSong();
+            nextIndex = -1;
+        }
         void init()
         {
             /*
@@ -35,46 +214,55 @@ namespace platformer
             {
                 std::string placeholder(musicInDirectory.paths[i]);
                 playlist.push_back(song());
-                playlist.at(playlist.size() - 1).music = LoadMusicStream(placeholder.c_str());
+                playlist.at(playlist.size() - 1).path = placeholder;
                 playlist.at(playlist.size() - 1).Title = "Now Playing: " + placeholder.substr(14);
             }
             UnloadDirectoryFiles(musicInDirectory);
-            for (song &i : playlist)
+            if (playlist.empty())
             {
-                i.music.looping = 0;
+                return;
             }
             currentlyPlayingIndex = (rand() % playlist.size());
-            activeMusic = &playlist.at(currentlyPlayingIndex).music;
+            readSong(playlist.at(currentlyPlayingIndex).path, playing.bytes);
+            open(playing, currentlyPlayingIndex);
+            searchFrom = currentlyPlayingIndex;
         }
+        // Starts the audio thread, which plays from here on. Must be called after init and InitAudioDevice
+        void start()
+        {
+            if (!playlist.empty())
+            {
+                audioThread = std::thread(stream);
+            }
+        }
+        // Empty when there is no music
+        std::string currentTitle()
+        {
+            return playlist.empty() ? "" : playlist.at(currentlyPlayingIndex).Title;
+        }
+        // Shows the title of a song once the audio thread has started it
         void update(platformer::animatedText &aniText, double &time)
         {
-            UpdateMusicStream(*activeMusic);
-            if (GetMusicTimePlayed(*activeMusic) >= 0.999 * GetMusicTimeLength(*activeMusic))
+            if (songSequence != announcedSequence)
             {
-                StopMusicStream(*activeMusic);
-                currentlyPlayingIndex++;
-                currentlyPlayingIndex = currentlyPlayingIndex % playlist.size();
-                activeMusic = &playlist.at(currentlyPlayingIndex).music;
-                PlayMusicStream(*activeMusic);
-                aniText.setContent(playlist.at(currentlyPlayingIndex).Title.c_str());
+                announcedSequence = songSequence;
+                aniText.setContent(currentTitle().c_str());
                 aniText.revive(time, 10);
             }
         }
-        void skip(platformer::animatedText &aniText, double &time)
+        void skip()
         {
-            StopMusicStream(*activeMusic);
-            currentlyPlayingIndex++;
-            currentlyPlayingIndex = currentlyPlayingIndex % playlist.size();
-            activeMusic = &playlist.at(currentlyPlayingIndex).music;
-            PlayMusicStream(*activeMusic);
-            aniText.setContent(playlist.at(currentlyPlayingIndex).Title.c_str());
-            aniText.revive(time, 10);
+            commands.push(SkipSong);
         }
         void release()
         {
-            for (song &i : playlist)
+            if (audioThread.joinable())
             {
-                UnloadMusicStream(i.music);
+                while (!commands.push(StopAudio))
+                {
+                    std::this_thread::yield();
+                }
+                audioThread.join();
             }
         }
     }
@@ -85,10 +273,8 @@ namespace platformer
         Vector2 positionToDrawFPS;
         std::string cin;
         std::vector<std::string> arguments;
-        std::array<float, 100> frameTimes;
         bool isInConsole;
         bool fpsIsVisible{0};
-        int indexToEdit{0};
     private:
         // These pointers are needed since this class needs access to everything
         Vector2 * windowResolution = nullptr;
@@ -98,9 +284,10 @@ namespace platformer
         std::string * levelFilename = nullptr;
         platformer::animatedText * aniText = nullptr;
         double * currentTime = nullptr;
-        platformer::player * player = nullptr;
+        platformer::blocks::simulationRequests * requests = nullptr;
+        platformer::stats::frameStats * frameStatistics = nullptr;
     public:
-        void assignPointers(Vector2 * winRes, Vector2 * mousePos, float * hypo, wchar_t * keypress, std::string * filename, platformer::animatedText * animatedText, double * time, platformer::player * play)
+        void assignPointers(Vector2 * winRes, Vector2 * mousePos, float * hypo, wchar_t * keypress, std::string * filename, platformer::animatedText * animatedText, double * time, platformer::blocks::simulationRequests * simulation, platformer::stats::frameStats * statistics)
         {
             windowResolution = winRes;
             mousePosition = mousePos;
@@ -109,28 +296,15 @@ namespace platformer
             levelFilename = filename;
             aniText = animatedText;
             currentTime = time;
-            player = play;
+            requests = simulation;
+            frameStatistics = statistics;
         }
         int draw()
         {
             int returnVal = 0;
             if (fpsIsVisible)
             {
-                frameTimes[indexToEdit] = GetFrameTime();
-                indexToEdit++;
-                indexToEdit = indexToEdit % 100;
-                float sum{0};
-                for (int i = 0; i < 100; i++)
-                {
-                    sum += frameTimes[indexToEdit];
-                }
-                float mean = sum / 100.0f;
-                for (int i = 0; i < 50; i++)
-                {
-                    DrawLine(i, ((frameTimes[i] / mean) * 10) + windowResolution->y / 2, i + 1, ((frameTimes[i + 1] / mean) * 10) + windowResolution->y / 2, YELLOW);
-                }
-                DrawText(TextFormat("FPS: %d", (int)(1.0f / mean)), positionToDrawFPS.x * windowResolution->x, positionToDrawFPS.y * windowResolution->y, 0.01f * (*hypotenuse), YELLOW);
-                // DrawText(TextFormat("stddvn: %f", stdv), positionToDrawFPS.x * windowResolution.x, (0.1f + positionToDrawFPS.y) * windowResolution.y, 0.01f * hypotenuse, YELLOW);
+                frameStatistics->draw({positionToDrawFPS.x * windowResolution->x, positionToDrawFPS.y * windowResolution->y}, 0.01f * (*hypotenuse), *windowResolution);
             }
             if (isInConsole)
             {
@@ -196,23 +370,72 @@ namespace platformer
                                 SetTargetFPS(std::stoi(arguments.at(2)));
                                 throw std::invalid_argument("FPS capped to " + arguments.at(2) + "FPS");
                             }
+                            if (arguments.at(1) == "chunkcache" && arguments.size() > 2)
+                            {
+                                platformer::settings::chunkCacheMegabytes = std::stoul(arguments.at(2));
+                                throw std::invalid_argument("Chunk cache limited to " + arguments.at(2) + "MB");
+                            }
+                            if (arguments.at(1) == "statswindow" && arguments.size() > 2)
+                            {
+                                frameStatistics->setWindow(std::stoul(arguments.at(2)));
+                                throw std::invalid_argument("Frame statistics cover the last " + arguments.at(2) + " frames");
+                            }
                             if (arguments.at(1) == "volume" && arguments.size() > 2)
                             {
                                 SetMasterVolume(std::stof(arguments.at(2)));
                                 throw std::invalid_argument("Set Volume to " + arguments.at(2));
                             }
                         }
+                        if (arguments.at(0) == "/stats")
+                        {
+                            if (arguments.at(1) == "dump" && arguments.size() > 2)
+                            {
+                                if (!frameStatistics->writeCSV(arguments.at(2)))
+                                {
+                                    throw std::invalid_argument("Could not write " + arguments.at(2));
+                                }
+                                throw std::invalid_argument("Frame statistics written to " + arguments.at(2));
+                            }
+                            if (arguments.at(1) == "reset")
+                            {
+                                frameStatistics->reset();
+                                throw std::invalid_argument("Frame statistics cleared");
+                            }
+                        }
+                        if (arguments.at(0) == "/profile")
+                        {
+                            if (!platformer::profiler::compiledIn)
+                            {
+                                throw std::invalid_argument("Profiling is not built in, build with make profile");
+                            }
+                            if (arguments.at(1) == "start")
+                            {
+                                platformer::profiler::start();
+                                throw std::invalid_argument("Profiling started");
+                            }
+                            if (arguments.at(1) == "stop" && arguments.size() > 2)
+                            {
+                                size_t zones{0};
+                                if (!platformer::profiler::stop(arguments.at(2), zones))
+                                {
+                                    throw std::invalid_argument("Could not write " + arguments.at(2));
+                                }
+                                throw std::invalid_argument("Wrote " + std::to_string(zones) + " zones to " + arguments.at(2));
+                            }
+                        }
                         if (arguments.at(0) == "/skip")
                         {
                             if (arguments.at(1) == "music")
                             {
-                                platformer::music::skip(*aniText, *currentTime);
+                                platformer::music::skip();
                             }
                         }
                         if (arguments.at(0) == "/move")
                         {
                             Vector2 gamePos = GetScreenToWorld2D(*mousePosition, platformer::blocks::inGameCamera);
-                            player->setPosition(gamePos.x, gamePos.y);
+                            requests->teleportX = gamePos.x;
+                            requests->teleportY = gamePos.y;
+                            requests->teleport = 1;
                             throw std::invalid_argument("Player teleported to " + std::to_string(gamePos.x) + ' ' + std::to_string(gamePos.y));
                         }
                     }
@@ -0,0 +1,263 @@
+#pragma once
+#include "classes.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace platformer
+{
+    // Frame time statistics for the /showfps overlay. Everything is kept in microseconds and shown in milliseconds
+    namespace stats
+    {
+        float microsecondsSince(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+        // Samples over the last windowSize frames, counted in log-linear buckets like HdrHistogram. Every power of two
+        // is split into subBuckets equal buckets, so a percentile is never more than about 3% off however long the
+        // frame was, and reading one only walks the buckets instead of sorting the window
+        class histogram
+        {
+        public:
+            static const int subBucketBits = 5;
+            static const int subBuckets = 1 << subBucketBits;
+            // Values up to 2^32 microseconds, over an hour, get their own bucket. Anything longer lands in the last one
+            static const int bucketCount = (32 - subBucketBits + 1) * subBuckets;
+
+        protected:
+            std::array<unsigned int, bucketCount> counts{};
+            // The window itself, oldest sample at next once it is full
+            std::vector<float> window;
+            size_t next{0};
+            size_t filled{0};
+
+        public:
+            static int bucketOf(float microseconds)
+            {
+                unsigned long long value = microseconds > 0 ? (unsigned long long)microseconds : 0;
+                value = std::min(value, 0xffffffffull);
+                if (value < subBuckets)
+                {
+                    return (int)value;
+                }
+                int highestBit = 63 - __builtin_clzll(value);
+                int shift = highestBit - subBucketBits;
+                return (highestBit - subBucketBits + 1) * subBuckets + (int)((value >> shift) - subBuckets);
+            }
+            // The largest value that falls into bucket
+            static float bucketValue(int bucket)
+            {
+                if (bucket < subBuckets)
+                {
+                    return bucket;
+                }
+                int shift = bucket / subBuckets - 1;
+                unsigned long long lowest = (unsigned long long)(bucket % subBuckets + subBuckets) << shift;
+                return (float)(lowest + (1ull << shift) - 1);
+            }
+            histogram()
+            {
+                setWindow(600);
+            }
+            // Clears every sample
+            void setWindow(size_t frames)
+            {
+                window.assign(std::max<size_t>(frames, 1), 0);
+                clear();
+            }
+            size_t getWindow()
+            {
+                return window.size();
+            }
+            void clear()
+            {
+                counts.fill(0);
+                next = 0;
+                filled = 0;
+            }
+            void add(float microseconds)
+            {
+                if (filled == window.size())
+                {
+                    counts[bucketOf(window[next])]--;
+                }
+                else
+                {
+                    filled++;
+                }
+                window[next] = microseconds;
+                next = (next + 1) % window.size();
+                counts[bucketOf(microseconds)]++;
+            }
+            size_t size()
+            {
+                return filled;
+            }
+            // Nearest rank, so percentile(1) is the highest bucket in the window. 0 if there are no samples
+            float percentile(float p)
+            {
+                if (filled == 0)
+                {
+                    return 0;
+                }
+                size_t rank = std::max<size_t>((size_t)std::ceil(p * filled), 1);
+                size_t seen{0};
+                for (int i = 0; i < bucketCount; i++)
+                {
+                    seen += counts[i];
+                    if (seen >= rank)
+                    {
+                        return std::min(bucketValue(i), max());
+                    }
+                }
+                return max();
+            }
+            // Exact, unlike the percentiles
+            float max()
+            {
+                float highest{0};
+                for (size_t i = 0; i < filled; i++)
+                {
+                    highest = std::max(highest, window[i]);
+                }
+                return highest;
+            }
+            float mean()
+            {
+                double sum{0};
+                for (size_t i = 0; i < filled; i++)
+                {
+                    sum += window[i];
+                }
+                return filled > 0 ? sum / filled : 0;
+            }
+            unsigned int getCount(int bucket)
+            {
+                return counts[bucket];
+            }
+        };
+        // Physics step times on their way to the render thread. Samples are dropped while it is full
+        typedef spscQueue<float, 1024> sampleQueue;
+        // Render, physics and culling are timed on their own so a slow frame can be put down to one of them.
+        // Render is everything between BeginDrawing and EndDrawing, culling included
+        class frameStats
+        {
+        public:
+            // A frame counts as a hitch when it takes this many times as long as the median frame
+            static constexpr float hitchFactor = 2.0f;
+            histogram frame;
+            histogram render;
+            histogram physics;
+            histogram culling;
+            // Filled by the physics thread, one sample per step
+            sampleQueue physicsSteps;
+
+        protected:
+            std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+            size_t hitches{0};
+            float lastHitch{0};
+
+        public:
+            // The next frame is timed from now. Called after loading so that a level load is not counted as a frame
+            void restartClock()
+            {
+                lastFrame = std::chrono::steady_clock::now();
+            }
+            // Called once a frame, times the frame since the last call and collects the physics steps since then
+            void endFrame()
+            {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                float frameTime = std::chrono::duration<float, std::micro>(now - lastFrame).count();
+                lastFrame = now;
+                if (frame.size() > 0 && frameTime > hitchFactor * frame.percentile(0.5f))
+                {
+                    hitches++;
+                    lastHitch = frameTime;
+                }
+                frame.add(frameTime);
+                float step;
+                while (physicsSteps.pop(step))
+                {
+                    physics.add(step);
+                }
+            }
+            void setWindow(size_t frames)
+            {
+                frame.setWindow(frames);
+                render.setWindow(frames);
+                physics.setWindow(frames);
+                culling.setWindow(frames);
+            }
+            void reset()
+            {
+                setWindow(frame.getWindow());
+                hitches = 0;
+                lastHitch = 0;
+            }
+            size_t getHitches()
+            {
+                return hitches;
+            }
+            // One row per timing. Returns false if the file could not be written
+            bool writeCSV(const std::string &filename)
+            {
+                std::ofstream output(filename);
+                if (!output)
+                {
+                    std::cerr << "ERROR: STATS: Could not write " << filename << '\n';
+                    return false;
+                }
+                output << "timing,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms,hitches" << '\n';
+                const char *names[] = {"frame", "render", "physics", "culling"};
+                histogram *timings[] = {&frame, &render, &physics, &culling};
+                for (int i = 0; i < 4; i++)
+                {
+                    histogram &h = *timings[i];
+                    output << names[i] << ',' << h.size() << ',' << h.mean() / 1000 << ',' << h.percentile(0.5f) / 1000 << ',' << h.percentile(0.95f) / 1000 << ',' << h.percentile(0.99f) / 1000 << ',' << h.max() / 1000 << ',' << (i == 0 ? hitches : 0) << '\n';
+                }
+                return (bool)output;
+            }
+            // Percentiles of every timing, then the frame time histogram from half the median up to the slowest frame
+            void draw(Vector2 position, float fontSize, Vector2 resolution)
+            {
+                const char *names[] = {"Frame", "Render", "Physics", "Culling"};
+                histogram *timings[] = {&frame, &render, &physics, &culling};
+                float median = frame.percentile(0.5f);
+                DrawText(TextFormat("FPS: %d  Hitches: %d (last %.1f ms)", median > 0 ? (int)(1000000.0f / median) : 0, (int)hitches, lastHitch / 1000), position.x, position.y, fontSize, YELLOW);
+                for (int i = 0; i < 4; i++)
+                {
+                    histogram &h = *timings[i];
+                    DrawText(TextFormat("%-8s p50 %6.2f  p95 %6.2f  p99 %6.2f  max %6.2f ms", names[i], h.percentile(0.5f) / 1000, h.percentile(0.95f) / 1000, h.percentile(0.99f) / 1000, h.max() / 1000), position.x, position.y + (i + 1) * fontSize * 1.2f, fontSize, YELLOW);
+                }
+                int first = histogram::bucketOf(median / 2);
+                int last = histogram::bucketOf(frame.max());
+                if (frame.size() == 0 || last < first)
+                {
+                    return;
+                }
+                unsigned int tallest{1};
+                for (int i = first; i <= last; i++)
+                {
+                    tallest = std::max(tallest, frame.getCount(i));
+                }
+                Rectangle area = {position.x, position.y + 6 * fontSize * 1.2f, resolution.x * 0.3f, resolution.y * 0.15f};
+                float barWidth = area.width / (last - first + 1);
+                for (int i = first; i <= last; i++)
+                {
+                    // Square root so that the few slow frames are still visible next to the many normal ones
+                    float height = area.height * std::sqrt((float)frame.getCount(i) / tallest);
+                    DrawRectangleRec({area.x + (i - first) * barWidth, area.y + area.height - height, std::max(barWidth - 1, 1.0f), height}, YELLOW);
+                }
+                DrawRectangleLinesEx(area, 1, YELLOW);
+                DrawText(TextFormat("%.1f ms", histogram::bucketValue(first) / 1000), area.x, area.y + area.height + 2, fontSize * 0.8f, YELLOW);
+                const char *slowest = TextFormat("%.1f ms", frame.max() / 1000);
+                DrawText(slowest, area.x + area.width - MeasureText(slowest, fontSize * 0.8f), area.y + area.height + 2, fontSize * 0.8f, YELLOW);
+            }
+        };
+    }
+}
@@ -0,0 +1,131 @@
+#include "headers/blocks.hpp"
+
+// Runs the simulation without a window, audio or textures and reports how fast physics runs.
+// An input script has one "<tick> <keys>" line per change of input, where keys is any of R (right), L (left), J (jump), C (checkpoint) or - for nothing.
+// Each line holds from its tick until the next line. Without a script the player runs back and forth and jumps
+namespace platformer
+{
+    namespace headless
+    {
+        struct scriptedInput
+        {
+            int tick;
+            std::string keys;
+        };
+        bool loadScript(const char *filename, std::vector<scriptedInput> &dest)
+        {
+            std::ifstream input(filename);
+            if (!input)
+            {
+                return false;
+            }
+            scriptedInput cache;
+            while (input >> cache.tick >> cache.keys)
+            {
+                dest.push_back(cache);
+            }
+            std::sort(dest.begin(), dest.end(), [](const scriptedInput &a, const scriptedInput &b)
+                      { return a.tick < b.tick; });
+            return true;
+        }
+        void defaultScript(int ticks, std::vector<scriptedInput> &dest)
+        {
+            for (int i = 0; i < ticks; i += 50)
+            {
+                dest.push_back({i, ((i / 200) % 2 == 0) ? "RJ" : "LJ"});
+                dest.push_back({i + 1, ((i / 200) % 2 == 0) ? "R" : "L"});
+            }
+        }
+        void setKeys(const std::string &keys, blocks::inputState &activeKeypresses)
+        {
+            activeKeypresses[0] = keys.find('R') != std::string::npos;
+            activeKeypresses[1] = keys.find('L') != std::string::npos;
+            activeKeypresses[2] = keys.find('J') != std::string::npos;
+            activeKeypresses[3] = keys.find('C') != std::string::npos;
+        }
+        // Nearest rank percentile of a sorted list
+        double percentile(std::vector<double> &sorted, double p)
+        {
+            size_t rank = (size_t)std::ceil(p * sorted.size());
+            return sorted.at(rank > 0 ? rank - 1 : 0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <level> [ticks] [input script]" << '\n';
+        return 1;
+    }
+    int ticks = 3600;
+    if (argc > 2)
+    {
+        ticks = std::atoi(argv[2]);
+        if (ticks <= 0)
+        {
+            std::cerr << "ERROR: Tick count must be positive" << '\n';
+            return 1;
+        }
+    }
+    std::vector<platformer::headless::scriptedInput> script;
+    if (argc > 3)
+    {
+        if (!platformer::headless::loadScript(argv[3], script))
+        {
+            std::cerr << "ERROR: Could not read " << argv[3] << '\n';
+            return 1;
+        }
+    }
+    else
+    {
+        platformer::headless::defaultScript(ticks, script);
+    }
+    platformer::blocks::init();
+    std::vector<platformer::tile> staticBlocks;
+    std::vector<platformer::stationaryAnimatedBlock> animatedBlocks;
+    platformer::triggerIndex triggers;
+    platformer::tileGrid staticGrid;
+    Color background;
+    if (!FileExists(argv[1]))
+    {
+        std::cerr << "ERROR: Could not read " << argv[1] << '\n';
+        return 1;
+    }
+    platformer::blocks::loadFromFile(argv[1], staticBlocks, animatedBlocks, triggers, staticGrid, background);
+    platformer::player player = platformer::blocks::templatePlayer;
+    platformer::animatedText animatedText;
+    std::string file = "0";
+    platformer::blocks::inputState activeKeypresses{};
+    std::vector<double> latencies;
+    latencies.reserve(ticks);
+    size_t nextInput{0};
+    std::string heldKeys = "-";
+    int ticksRun{0};
+    std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+    for (; ticksRun < ticks && !player.getReloadStatus(); ticksRun++)
+    {
+        // Same clock as the game's physics thread, lasers switch on and off from it
+        double time = (ticksRun + 1) * platformer::blocks::physicsStepSeconds;
+        while (nextInput < script.size() && script.at(nextInput).tick <= ticksRun)
+        {
+            heldKeys = script.at(nextInput).keys;
+            nextInput++;
+        }
+        // The game sets held keys every frame, so they are set again every tick here
+        platformer::headless::setKeys(heldKeys, activeKeypresses);
+        std::chrono::steady_clock::time_point tickStart = std::chrono::steady_clock::now();
+        player.doPhysicsStep(staticBlocks, animatedBlocks, triggers, staticGrid, platformer::blocks::physicsStepSeconds, time, file, animatedText);
+        platformer::blocks::applyInput(player, activeKeypresses);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tickStart).count());
+    }
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Level: " << argv[1] << " (" << staticBlocks.size() << " tiles, " << animatedBlocks.size() << " animated blocks)" << '\n';
+    std::cout << "Ticks: " << ticksRun << (player.getReloadStatus() ? " (stopped at the portal)" : "") << '\n';
+    std::cout << "Ticks per second: " << ticksRun / totalSeconds << '\n';
+    std::cout << "Tick latency (us): p50 " << platformer::headless::percentile(latencies, 0.5) << ", p90 " << platformer::headless::percentile(latencies, 0.9) << ", p99 " << platformer::headless::percentile(latencies, 0.99) << ", max " << latencies.back() << '\n';
+    std::cout << "Player: " << player.getPosition().x << ' ' << player.getPosition().y << ", " << player.getDeathCount() << " deaths" << '\n';
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "headers/level.hpp"
+
+// Converts levels between the text, binary and compressed formats. See headers/level.hpp for a description of each
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <input level> <output level> [text|binary|compressed]" << '\n';
+        std::cerr << "Text levels are converted to binary and binary levels to text unless a format is given" << '\n';
+        return 1;
+    }
+    platformer::level::levelData source;
+    if (!source.open(argv[1]))
+    {
+        std::cerr << "ERROR: Could not read " << argv[1] << '\n';
+        return 1;
+    }
+    bool inputIsBinary;
+    {
+        char header[sizeof(platformer::level::compressedHeader)] = {0};
+        std::ifstream input(argv[1], std::ios::in | std::ios::binary);
+        input.read(header, sizeof(header));
+        inputIsBinary = platformer::level::levelData::isBinary(header, input.gcount()) || platformer::level::levelData::isCompressed(header, input.gcount());
+    }
+    std::string format = inputIsBinary ? "text" : "binary";
+    if (argc > 3)
+    {
+        format = argv[3];
+        if (format != "text" && format != "binary" && format != "compressed")
+        {
+            std::cerr << "ERROR: Unknown format " << format << '\n';
+            return 1;
+        }
+    }
+    std::vector<platformer::level::blockRecord> records;
+    source.getRecords(records);
+    Color background = source.getBackground();
+    source.close();
+    bool written;
+    if (format == "binary")
+    {
+        written = platformer::level::writeBinary(argv[2], background, records);
+    }
+    else if (format == "compressed")
+    {
+        written = platformer::level::writeCompressed(argv[2], background, records);
+    }
+    else
+    {
+        written = platformer::level::writeText(argv[2], background, records);
+    }
+    if (!written)
+    {
+        std::cerr << "ERROR: Could not write " << argv[2] << '\n';
+        return 1;
+    }
+    std::cout << "Wrote " << records.size() << " blocks to " << argv[2] << " (" << format << ')' << '\n';
+    return 0;
+}
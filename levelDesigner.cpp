@@ -35,7 +35,8 @@ namespace platformer
             inGamePositionDimension.height = hgt;
             rotation = rot;
         }
-        void computeRay(std::vector<editorBlock> &obstecules)
+        // Walks the cells along the beam and stops at the first block. isOccupied(x, y) tells if a block has its top left corner in a cell
+        void computeRay(std::function<bool(int, int)> isOccupied)
         {
             Vector2 origion;
             int lowest{4096};
@@ -48,99 +49,172 @@ namespace platformer
             p2 = platformer::rotatePointAroundOtherPoint(p2, origion, rotation);
             beginOfRay = p1;
             endOfRay = p2;
-            for (size_t i = 0; i < obstecules.size(); i++)
+            rayLength = lowest;
+            int ownX = tileGrid::toCell(inGamePositionDimension.x);
+            int ownY = tileGrid::toCell(inGamePositionDimension.y);
+            tileGrid::traverse(p1, p2, [&](int x, int y)
+                               {
+                                   if ((x == ownX && y == ownY) || !isOccupied(x, y))
+                                   {
+                                       return false;
+                                   }
+                                   Vector2 cache{x * (float)tileGrid::cellSize + halfSpriteWidth, y * (float)tileGrid::cellSize + halfSpriteWidth};
+                                   if (!CheckCollisionPointLine(cache, p1, p2, halfSpriteWidth + 1))
+                                   {
+                                       return false;
+                                   }
+                                   rayLength = (int)sqrt(pow((cache.x) - p1.x, 2) + pow((cache.y) - p1.y, 2));
+                                   endOfRay = cache;
+                                   return true; });
+        }
+    };
+    // Finds the block in a cell without scanning the level. Blocks are keyed by the cell of their top left corner
+    class occupancyIndex
+    {
+    protected:
+        std::unordered_map<long long, size_t> cells;
+        size_t playerSpawns{0};
+
+    public:
+        static long long cellKey(int x, int y)
+        {
+            return ((long long)x << 32) | (unsigned int)y;
+        }
+        static long long cellKey(Vector2 position)
+        {
+            return cellKey(tileGrid::toCell(position.x), tileGrid::toCell(position.y));
+        }
+        void rebuild(std::vector<editorBlock> &blocks)
+        {
+            cells.clear();
+            playerSpawns = 0;
+            for (size_t i = 0; i < blocks.size(); i++)
+            {
+                cells[cellKey(blocks.at(i).getPosition())] = i;
+                playerSpawns += (blocks.at(i).getType() == valuesOfBlocks::PlayerSpawn);
+            }
+        }
+        // Returns the index of the block in cell, or -1 if it is empty
+        long long find(long long cell)
+        {
+            std::unordered_map<long long, size_t>::iterator found = cells.find(cell);
+            return (found == cells.end()) ? -1 : (long long)found->second;
+        }
+        bool isOccupied(int x, int y)
+        {
+            return cells.find(cellKey(x, y)) != cells.end();
+        }
+        bool hasPlayerSpawn()
+        {
+            return playerSpawns > 0;
+        }
+        void place(std::vector<editorBlock> &blocks, editorBlock block)
+        {
+            cells[cellKey(block.getPosition())] = blocks.size();
+            playerSpawns += (block.getType() == valuesOfBlocks::PlayerSpawn);
+            blocks.push_back(block);
+        }
+        // Moves the last block into the hole so nothing else has to shift
+        void erase(std::vector<editorBlock> &blocks, size_t index)
+        {
+            playerSpawns -= (blocks.at(index).getType() == valuesOfBlocks::PlayerSpawn);
+            cells.erase(cellKey(blocks.at(index).getPosition()));
+            if (index != blocks.size() - 1)
+            {
+                blocks.at(index) = blocks.back();
+                cells[cellKey(blocks.at(index).getPosition())] = index;
+            }
+            blocks.pop_back();
+        }
+    };
+    // Remembers which cells every laser beam passes through, so an edit only recomputes the lasers it can change
+    class beamIndex
+    {
+    protected:
+        // Cell -> cells of the lasers whose beam passes through it
+        std::unordered_map<long long, std::vector<long long>> lasersByCell;
+        // Cell of a laser -> cells its beam passes through
+        std::unordered_map<long long, std::vector<long long>> cellsByLaser;
+        std::vector<long long> affected;
+
+    public:
+        void clear()
+        {
+            lasersByCell.clear();
+            cellsByLaser.clear();
+        }
+        // Computes the beam of a laser and records every cell from the laser up to and including whatever stops it
+        void track(editorBlock &laser, occupancyIndex &occupancy)
+        {
+            laser.computeRay([&](int x, int y)
+                             { return occupancy.isOccupied(x, y); });
+            long long laserCell = occupancyIndex::cellKey(laser.getPosition());
+            std::vector<long long> &cells = cellsByLaser[laserCell];
+            tileGrid::traverse(laser.getBeginOfRay(), laser.getEndOfRay(), [&](int x, int y)
+                               {
+                                   cells.push_back(occupancyIndex::cellKey(x, y));
+                                   lasersByCell[cells.back()].push_back(laserCell);
+                                   return false; });
+        }
+        void forget(long long laserCell)
+        {
+            std::unordered_map<long long, std::vector<long long>>::iterator found = cellsByLaser.find(laserCell);
+            if (found == cellsByLaser.end())
+            {
+                return;
+            }
+            for (long long cell : found->second)
             {
-                Vector2 cache = obstecules.at(i).getPosition();
-                cache.x += halfSpriteWidth;
-                cache.y += halfSpriteWidth;
-                if (&obstecules.at(i) != this)
+                std::vector<long long> &lasers = lasersByCell[cell];
+                lasers.erase(std::find(lasers.begin(), lasers.end(), laserCell));
+                if (lasers.empty())
                 {
-                    if (CheckCollisionPointLine(cache, p1, p2, halfSpriteWidth + 1))
-                    {
-                        float placeholder = sqrt(pow((cache.x) - p1.x, 2) + pow((cache.y) - p1.y, 2));
-                        if (placeholder < lowest)
-                        {
-                            lowest = placeholder;
-                            endOfRay = cache;
-                        }
-                    }
+                    lasersByCell.erase(cell);
+                }
+            }
+            cellsByLaser.erase(found);
+        }
+        // Must be called after a block is placed in or removed from cell
+        void refresh(long long cell, std::vector<editorBlock> &blocks, occupancyIndex &occupancy)
+        {
+            std::unordered_map<long long, std::vector<long long>>::iterator found = lasersByCell.find(cell);
+            if (found == lasersByCell.end())
+            {
+                return;
+            }
+            // forget() changes the list being looked at, so work on a copy
+            affected = found->second;
+            for (long long laserCell : affected)
+            {
+                long long index = occupancy.find(laserCell);
+                forget(laserCell);
+                if (index != -1)
+                {
+                    track(blocks.at(index), occupancy);
                 }
             }
-            rayLength = lowest;
         }
     };
     namespace blocks
     {
         namespace editor
         {
-            editorBlock grass;
-            editorBlock dirt;
-            editorBlock brick;
-            editorBlock laser;
-            editorBlock lava;
-            editorBlock playerSpawn;
-            editorBlock portal;
-            editorBlock brickR;
-            editorBlock brickO;
-            editorBlock brickY;
-            editorBlock brickG;
-            editorBlock brickB;
-            editorBlock brickP;
-            editorBlock brickW;
-            editorBlock accessPoint;
-            editorBlock susJuice;
+            // Indexed by (valuesOfBlocks - Grass), built from the shared block registry
+            std::array<editorBlock, blockCount> prototypes;
             std::vector<editorBlock *> types;
             void init()
             {
-                grass.setPositionOnSpriteSheet({0, 0, 64, 64});
-                dirt.setPositionOnSpriteSheet({64, 0, 64, 64});
-                brick.setPositionOnSpriteSheet({128, 0, 64, 64});
-                laser.setPositionOnSpriteSheet({0, 1792, 64, 64});
-                lava.setPositionOnSpriteSheet({0, 1856, 64, 64});
-                playerSpawn.setPositionOnSpriteSheet({0, 1984, 64, 64});
-                portal.setPositionOnSpriteSheet({0, 192, 64, 64});
-                brickR.setPositionOnSpriteSheet({512, 0, 64, 64});
-                brickO.setPositionOnSpriteSheet({448, 0, 64, 64});
-                brickY.setPositionOnSpriteSheet({384, 0, 64, 64});
-                brickG.setPositionOnSpriteSheet({320, 0, 64, 64});
-                brickB.setPositionOnSpriteSheet({256, 0, 64, 64});
-                brickP.setPositionOnSpriteSheet({256, 64, 64, 64});
-                brickW.setPositionOnSpriteSheet({320, 64, 64, 64});
-                accessPoint.setPositionOnSpriteSheet({576, 0, 64, 64});
-                accessPoint.setDimentions(128, 128);
-                susJuice.setPositionOnSpriteSheet({0, 1664, 64, 64});
-                grass.setType(valuesOfBlocks::Grass);
-                dirt.setType(valuesOfBlocks::Dirt);
-                brick.setType(valuesOfBlocks::Brick);
-                laser.setType(valuesOfBlocks::LaserNoTimeOffset);
-                lava.setType(valuesOfBlocks::Lava);
-                portal.setType(valuesOfBlocks::Portal);
-                brickR.setType(valuesOfBlocks::BrickR);
-                brickO.setType(valuesOfBlocks::BrickO);
-                brickY.setType(valuesOfBlocks::BrickY);
-                brickG.setType(valuesOfBlocks::BrickG);
-                brickB.setType(valuesOfBlocks::BrickB);
-                brickP.setType(valuesOfBlocks::BrickP);
-                brickW.setType(valuesOfBlocks::BrickW);
-                accessPoint.setType(valuesOfBlocks::AccessPoint);
-                susJuice.setType(valuesOfBlocks::SusJuice);
-                playerSpawn.setType(valuesOfBlocks::PlayerSpawn);
-                types.push_back(&grass);
-                types.push_back(&dirt);
-                types.push_back(&brick);
-                types.push_back(&laser);
-                types.push_back(&lava);
-                types.push_back(&playerSpawn);
-                types.push_back(&portal);
-                types.push_back(&brickR);
-                types.push_back(&brickO);
-                types.push_back(&brickY);
-                types.push_back(&brickG);
-                types.push_back(&brickB);
-                types.push_back(&brickP);
-                types.push_back(&brickW);
-                types.push_back(&accessPoint);
-                types.push_back(&susJuice);
+                for (int i = 0; i < blockCount; i++)
+                {
+                    prototypes[i].setPositionOnSpriteSheet(blockRegistry[i].positionOnSpriteSheet);
+                    prototypes[i].setDimentions(blockRegistry[i].width, blockRegistry[i].height);
+                    prototypes[i].setType(blockRegistry[i].id);
+                    types.push_back(&prototypes[i]);
+                }
+            }
+            editorBlock &getPrototype(int type)
+            {
+                return prototypes[type - valuesOfBlocks::Grass];
             }
             bool clickCheck(Vector2 &mousePos, editorBlock *subject)
             {
@@ -161,9 +235,11 @@ int main()
 {
     srand(time(nullptr));
     platformer::blocks::editor::init();
-    platformer::editorBlock selectedBlock = platformer::blocks::editor::brick;
+    platformer::editorBlock selectedBlock = platformer::blocks::editor::getPrototype(platformer::valuesOfBlocks::Brick);
     platformer::animatedText animatedText;
     std::vector<platformer::editorBlock> blocks;
+    platformer::occupancyIndex occupancy;
+    platformer::beamIndex beams;
     Vector2 resolution{1900, 1060};
     Vector2 mousePosition;
     Vector2 snappingMousePosition;
@@ -296,42 +372,21 @@ int main()
         {
             if (CheckCollisionPointRec(mousePosition, {(resolution.x * 0.1f), 0, resolution.x * 0.9f, resolution.y}))
             {
-                bool duplicateFound{0};
-                for (size_t i = 0; i < blocks.size(); i++)
+                long long cell = platformer::occupancyIndex::cellKey(snappingMousePosition);
+                if (snappingMousePosition.y < 0)
                 {
-                    if (blocks.at(i).getType() == platformer::valuesOfBlocks::PlayerSpawn && selectedBlock.getType() == platformer::valuesOfBlocks::PlayerSpawn)
-                    {
-                        duplicateFound = 1;
-                        break;
-                    }
-                    if (snappingMousePosition.y < 0)
-                    {
-                        duplicateFound = 1;
-                        animatedText.setContent("You can only place blocks in the positive y-axis");
-                        animatedText.setDestination(0.1f, 0.7f);
-                        animatedText.revive(time, 3);
-                        break;
-                    }
-                    if (snappingMousePosition.x == blocks.at(i).getPosition().x && snappingMousePosition.y == blocks.at(i).getPosition().y)
-                    {
-                        duplicateFound = 1;
-                        break;
-                    }
+                    animatedText.setContent("You can only place blocks in the positive y-axis");
+                    animatedText.setDestination(0.1f, 0.7f);
+                    animatedText.revive(time, 3);
                 }
-                if (!duplicateFound)
+                else if (occupancy.find(cell) == -1 && !(selectedBlock.getType() == platformer::valuesOfBlocks::PlayerSpawn && occupancy.hasPlayerSpawn()))
                 {
-                    blocks.push_back(platformer::editorBlock(selectedBlock, snappingMousePosition.x, snappingMousePosition.y, 64, 64, defaultRotation));
-                    blocks.at(blocks.size() - 1).setVisibility(1);
-                    if (blocks.at(blocks.size() - 1).getType() == platformer::valuesOfBlocks::AccessPoint)
+                    const platformer::blockInfo &info = platformer::getBlockInfo(selectedBlock.getType());
+                    occupancy.place(blocks, platformer::editorBlock(selectedBlock, snappingMousePosition.x, snappingMousePosition.y, info.width, info.height, defaultRotation));
+                    beams.refresh(cell, blocks, occupancy);
+                    if (blocks.back().getType() == platformer::valuesOfBlocks::LaserNoTimeOffset)
                     {
-                        blocks.at(blocks.size() - 1).setDimentions(128, 128);
-                    }
-                    for (size_t i = 0; i < blocks.size(); i++)
-                    {
-                        if (blocks.at(i).getType() == platformer::valuesOfBlocks::LaserNoTimeOffset)
-                        {
-                            blocks.at(i).computeRay(blocks);
-                        }
+                        beams.track(blocks.back(), occupancy);
                     }
                 }
             }
@@ -340,45 +395,16 @@ int main()
         {
             if ((CheckCollisionPointRec(mousePosition, {(resolution.x * 0.1f), 0, resolution.x * 0.9f, resolution.y})))
             {
-                for (size_t i = 0; i < blocks.size(); i++)
+                long long cell = platformer::occupancyIndex::cellKey(snappingMousePosition);
+                long long index = occupancy.find(cell);
+                if (index != -1)
                 {
-                    if (snappingMousePosition.x == blocks.at(i).getPosition().x && snappingMousePosition.y == blocks.at(i).getPosition().y)
+                    if (blocks.at(index).getType() == platformer::valuesOfBlocks::LaserNoTimeOffset)
                     {
-                        /*
-                                    Since std::vector doesn't have a method for removing elements at an arbitrary index, i have to use this mess.
-                                    It swaps the element at the last index in the vector, and the element at the index to remove. From then you can pop off the last element, deleting it.
-                        */
-                        platformer::editorBlock *cache1 = new platformer::editorBlock;
-                        if (cache1 == nullptr)
-                        {
-                            animatedText.setContent("Failed to allocate memory");
-                            animatedText.setDestination(0.1f, 0.7f);
-                            animatedText.revive(time, 3);
-                            continue;
-                        }
-                        platformer::editorBlock *cache2 = new platformer::editorBlock;
-                        if (cache2 == nullptr)
-                        {
-                            delete cache1;
-                            animatedText.setContent("Failed to allocate memory");
-                            animatedText.setDestination(0.1f, 0.7f);
-                            animatedText.revive(time, 3);
-                            continue;
-                        }
-                        *cache1 = blocks.at(blocks.size() - 1);
-                        *cache2 = blocks.at(i);
-                        blocks.at(i) = *cache1;
-                        blocks.pop_back();
-                        delete cache1;
-                        delete cache2;
-                        for (size_t i = 0; i < blocks.size(); i++)
-                        {
-                            if (blocks.at(i).getType() == platformer::valuesOfBlocks::LaserNoTimeOffset)
-                            {
-                                blocks.at(i).computeRay(blocks);
-                            }
-                        }
+                        beams.forget(cell);
                     }
+                    occupancy.erase(blocks, index);
+                    beams.refresh(cell, blocks, occupancy);
                 }
             }
         }
@@ -499,20 +525,27 @@ int main()
                         std::sort(blocks.begin(), blocks.end(), [](platformer::editorBlock &lhs, platformer::editorBlock &rhs)
                                   { return (lhs.getPosition().y < rhs.getPosition().y) || ((lhs.getPosition().y == rhs.getPosition().y) && (lhs.getPosition().x < rhs.getPosition().x)); });
                         */
-                        std::stringstream buf;
-                        buf << (int)background.r << ' ' << (int)background.g << ' ' << (int)background.b << ' ' << (int)background.a << '\n';
+                        std::vector<platformer::level::blockRecord> records;
                         for (platformer::editorBlock &i : blocks)
                         {
                             Vector2 cache = i.getPosition();
-                            buf << cache.x << ' ' << cache.y << ' ' << i.getType() << ' ' << i.getRotation() << '\n';
+                            records.push_back({(int)cache.x, (int)cache.y, i.getType(), i.getRotation()});
                         }
                         realBuffers.at(1) = "levels/" + realBuffers.at(1);
-                        // std::cout << buf.str() << '\n';
-                        std::fstream output(realBuffers.at(1), std::ios::out | std::ios::trunc);
-                        output << buf.str();
-                        output.close();
-
-                        if (0)
+                        bool saved;
+                        if (realBuffers.size() > 2 && realBuffers.at(2) == "binary")
+                        {
+                            saved = platformer::level::writeBinary(realBuffers.at(1).c_str(), background, records);
+                        }
+                        else if (realBuffers.size() > 2 && realBuffers.at(2) == "compressed")
+                        {
+                            saved = platformer::level::writeCompressed(realBuffers.at(1).c_str(), background, records);
+                        }
+                        else
+                        {
+                            saved = platformer::level::writeText(realBuffers.at(1).c_str(), background, records);
+                        }
+                        if (!saved)
                         {
                             animatedText.setContent("Failed to write file");
                             animatedText.setDestination(0.1f, 0.7f);
@@ -551,100 +584,36 @@ int main()
                     else if (realBuffers.at(0) == "/load")
                     {
                         realBuffers.at(1) = "levels/" + realBuffers.at(1);
-                        // std::stringstream source = platformer::readCompressedData(realBuffers.at(1).c_str());
-                        //  For whatever reason, there is a bug with how data is compressed. For now every level will be uncompressed until this is fixed
-                        std::ifstream source(realBuffers.at(1), std::ios::in);
-                        blocks.clear();
+                        platformer::level::levelData source;
+                        if (!source.open(realBuffers.at(1).c_str()))
                         {
-                            std::string placeholder;
-                            std::getline(source, placeholder, '\n');
-                            std::stringstream iDontKnow(placeholder);
-                            std::vector<std::string> colors;
-                            while (std::getline(iDontKnow, placeholder, ' '))
-                            {
-                                colors.push_back(placeholder);
-                            }
-                            background.r = std::stoi(colors.at(0));
-                            background.g = std::stoi(colors.at(1));
-                            background.b = std::stoi(colors.at(2));
-                            background.a = std::stoi(colors.at(3));
+                            throw std::invalid_argument("Could not read " + realBuffers.at(1));
                         }
-                        std::string lineBuffer;
-                        while (std::getline(source, lineBuffer, '\n'))
+                        blocks.clear();
+                        background = source.getBackground();
+                        std::vector<platformer::level::blockRecord> records;
+                        source.getRecords(records);
+                        source.close();
+                        for (platformer::level::blockRecord &record : records)
                         {
-                            std::vector<int> parsableArguments;
-                            std::stringstream iDontKnow(lineBuffer);
-                            while (std::getline(iDontKnow, lineBuffer, ' '))
+                            if (!platformer::isKnownBlock(record.type))
                             {
-                                parsableArguments.push_back(std::stoi(lineBuffer));
-                            }
-                            if (parsableArguments.size() == 4)
-                            {
-                                switch (parsableArguments.at(2))
-                                {
-                                case (platformer::valuesOfBlocks::Grass):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::grass, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::Dirt):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::dirt, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::Brick):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brick, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::LaserNoTimeOffset):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::laser, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::Lava):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::lava, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::PlayerSpawn):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::playerSpawn, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    blocks.at(blocks.size() - 1).setPosition(parsableArguments.at(0), (parsableArguments.at(1)));
-                                    break;
-                                case (platformer::valuesOfBlocks::Portal):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::portal, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickR):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickR, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickO):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickO, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickY):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickY, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickG):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickG, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickB):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickB, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickP):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickP, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::BrickW):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::brickW, parsableArguments.at(0), parsableArguments.at(1), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::AccessPoint):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::accessPoint, parsableArguments.at(0), (parsableArguments.at(1)), 128, 128, parsableArguments.at(3)));
-                                    break;
-                                case (platformer::valuesOfBlocks::SusJuice):
-                                    blocks.push_back(platformer::editorBlock(platformer::blocks::editor::susJuice, parsableArguments.at(0), (parsableArguments.at(1)), 64, 64, parsableArguments.at(3)));
-                                    break;
-                                default:
-                                    break;
-                                }
+                                continue;
                             }
+                            const platformer::blockInfo &info = platformer::getBlockInfo(record.type);
+                            blocks.push_back(platformer::editorBlock(platformer::blocks::editor::getPrototype(record.type), record.x, record.y, info.width, info.height, record.rotation));
                         }
-                        viewPort.target = (blocks.at(rand() % blocks.size())).getPosition();
+                        // A level with only a background line has nothing to look at, so start at the origin
+                        viewPort.target = blocks.empty() ? Vector2{0, 0} : (blocks.at(rand() % blocks.size())).getPosition();
+                        occupancy.rebuild(blocks);
+                        beams.clear();
                         for (size_t i = 0; i < blocks.size(); i++)
                         {
                             if (blocks.at(i).getType() == platformer::valuesOfBlocks::LaserNoTimeOffset)
                             {
-                                blocks.at(i).computeRay(blocks);
+                                beams.track(blocks.at(i), occupancy);
                             }
                         }
-                        source.close();
                     }
                     else if (realBuffers.at(0) == "/showlasers")
                     {
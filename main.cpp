@@ -8,10 +8,19 @@ int main(int argc, char **argv)
     Vector2 resolution = {800, 400};
     InitWindow(resolution.x, resolution.y, "A Window");
     InitAudioDevice();
-    Texture2D spritesheet = LoadTexture("assets/tilesheet.png");
-    Image windowIcon = LoadImage("assets/icon.png");
+    platformer::jobs::init();
+    PROFILE_THREAD("Render");
+    // Images are decoded on the pool while everything else is set up. Only the upload to the GPU has to happen here
+    Image spritesheetImage;
+    Image windowIcon;
+    platformer::jobs::jobGroup assets;
+    platformer::jobs::pool.submit([&]()
+                                  { spritesheetImage = LoadImage("assets/tilesheet.png"); },
+                                  assets);
+    platformer::jobs::pool.submit([&]()
+                                  { windowIcon = LoadImage("assets/icon.png"); },
+                                  assets);
     SetExitKey(-1);
-    SetWindowIcon(windowIcon);
     SetWindowState(FLAG_WINDOW_RESIZABLE);
     std::string filename = "1";
     if (FileExists(".savedata"))
@@ -23,86 +32,92 @@ int main(int argc, char **argv)
     platformer::blocks::init();
     platformer::ui::init();
     platformer::music::init();
-    PlayMusicStream(*platformer::music::activeMusic);
-    std::vector<platformer::stationaryStaticBlock> staticBlocks;
+    platformer::jobs::pool.wait(assets);
+    Texture2D spritesheet = LoadTextureFromImage(spritesheetImage);
+    UnloadImage(spritesheetImage);
+    SetWindowIcon(windowIcon);
+    platformer::music::start();
+    std::vector<platformer::tile> staticBlocks;
     std::vector<platformer::stationaryAnimatedBlock> animatedBlocks;
+    platformer::triggerIndex triggers;
+    platformer::tileGrid staticGrid;
+    platformer::animationTable animations;
+    platformer::visibilityCuller culler;
+    platformer::renderQueue renderer;
+    platformer::blocks::chunkCache staticChunks;
+    platformer::stats::frameStats frameStatistics;
     while (isRunning)
     {
-        // Warn the user that this multithreaded program may not run correctly on old systems.
-        {
-            unsigned int threads = std::thread::hardware_concurrency();
-            if (threads < 5) { std::cerr << "WARN: SYSTEM: Your system supports only " << threads << " concurrent threads. You may experience stuttering or other bugs. Capping your framerate may resolve stuttering\n"; }
-        }
         std::string temporaryFileName = "levels/" + filename;
-        platformer::blocks::loadFromFile(temporaryFileName.c_str(), staticBlocks, animatedBlocks, background);
+        platformer::blocks::loadFromFile(temporaryFileName.c_str(), staticBlocks, animatedBlocks, triggers, staticGrid, background);
         Vector2 mousePosition{0, 0};
         float hypotenuse{1.0f};
-        float tickRate{1.0f / 60.0f};
+        std::atomic<float> tickRate{1.0f / 60.0f};
+        // The physics thread publishes a snapshot after each step. The render thread only ever reads the latest one
+        platformer::tripleBuffer<platformer::blocks::frameSnapshot> snapshots;
+        platformer::blocks::simulationRequests requests;
+        unsigned int shownHudSequence{0};
+        // Only the physics thread touches this until it is joined. It holds the next level once a portal is reached
+        std::string nextLevel = filename;
         double time {0};
-        // These variables are used for animation
-        size_t globalIterables[2] = {0, 0};
-        bool workerStatus{1};
+        std::atomic<bool> workerStatus{1};
         bool isPaused{0};
         wchar_t keypress{0};
         platformer::console console;
         platformer::player player = platformer::blocks::templatePlayer;
         platformer::animatedText animatedText;
         animatedText.setDestination(0.1f, 0.7f);
-        animatedText.setContent(platformer::music::playlist.at(platformer::music::currentlyPlayingIndex).Title.c_str());
+        animatedText.setContent(platformer::music::currentTitle().c_str());
         animatedText.revive(time, 10);
-        // Used for animation
-        player.setIterablePointer(&globalIterables[1]);
-        // Used to optimize collision checking and drawing
-        std::thread optimization([&]
-                                {
-                                while (workerStatus)
-                                {
-                                    for (size_t i = 0; i < staticBlocks.size(); i++)
-                                    {
-                                        Vector2 cache = GetWorldToScreen2D(staticBlocks.at(i).getPosition(), platformer::blocks::inGameCamera);
-                                        if (cache.x < resolution.x && cache.x > -64 && cache.y < resolution.y && cache.y > -64)
-                                        {
-                                            staticBlocks.at(i).setVisibility(1);
-                                            //float distance = sqrt((pow((staticBlocks.at(i).getPosition().x - platformer::blocks::inGameCamera.target.x), 2) + pow((staticBlocks.at(i).getPosition().y - platformer::blocks::inGameCamera.target.y), 2)));
-                                            //staticBlocks.at(i).setAlpha(((1152.0f - distance) / 1152.0f) * 255);
-                                        }
-                                        else
-                                        {
-                                            staticBlocks.at(i).setVisibility(0);
-                                        }
-                                    }
-                                    
-                                    //for (size_t i = 0; i < animatedBlocks.size(); i++)
-                                    //{
-                                    //    float distance = sqrt((pow((animatedBlocks.at(i).getPosition().x - platformer::blocks::inGameCamera.target.x), 2) + pow((animatedBlocks.at(i).getPosition().y - platformer::blocks::inGameCamera.target.y), 2)));
-                                    //    animatedBlocks.at(i).setAlpha(((1152.0f - distance) / 1152.0f) * 255);
-                                    //}
-                                    
-                                }           
-                                });
-        std::thread everyOneSec(platformer::blocks::incrementEveryMilliseconds, std::ref(globalIterables[0]), std::ref(workerStatus), 1000);
-        std::thread every100ms(platformer::blocks::incrementEveryMilliseconds, std::ref(globalIterables[1]), std::ref(workerStatus), 100);
-        std::thread every16ms(platformer::blocks::Every16Milliseconds, std::ref(staticBlocks), std::ref(animatedBlocks), std::ref(player), std::ref(workerStatus), std::ref(platformer::settings::activeKeypresses), std::ref(tickRate), std::ref(filename), std::ref(animatedText), std::ref(time));
-        for (int i = 0; i < animatedBlocks.size(); i++)
+        culler.build(staticBlocks, animatedBlocks, false);
+        animations.build(animatedBlocks);
+        staticChunks.build(staticBlocks);
+        // Started last so that the level is fully set up before physics reads it
         {
-            animatedBlocks.at(i).setIterablePointer(&globalIterables[1]);
-            if (animatedBlocks.at(i).getType() == platformer::Lava || animatedBlocks.at(i).getType() == platformer::SusJuice)
-            {
-                animatedBlocks.at(i).setIteratorOffset(i);
-            }
+            platformer::blocks::frameSnapshot &first = snapshots.getWriteBuffer();
+            first.steppedAt = std::chrono::steady_clock::now();
+            first.previousPosition = player.getPosition();
+            first.position = player.getPosition();
+            snapshots.publish();
         }
-        console.assignPointers(&resolution, &mousePosition, &hypotenuse, &keypress, &filename, &animatedText, &time, &player);
+        // Physics holds one worker until the level ends, nothing else starts or joins a thread between levels
+        platformer::jobs::jobGroup physics;
+        platformer::jobs::pool.submitLongRunning([&]()
+                                                 { platformer::blocks::fixedStepPhysics(staticBlocks, animatedBlocks, triggers, staticGrid, player, workerStatus, platformer::settings::activeKeypresses, tickRate, requests, snapshots, frameStatistics.physicsSteps, nextLevel); },
+                                                 physics);
+        console.assignPointers(&resolution, &mousePosition, &hypotenuse, &keypress, &filename, &animatedText, &time, &requests, &frameStatistics);
+        bool reachedPortal{0};
+        frameStatistics.restartClock();
         while (isRunning)
         {
-            platformer::music::update(animatedText, time);
+            PROFILE_ZONE("Frame");
+            frameStatistics.endFrame();
+            {
+                PROFILE_ZONE("Music update");
+                platformer::music::update(animatedText, time);
+            }
             time = GetTime();
+            snapshots.update();
+            const platformer::blocks::frameSnapshot &snapshot = snapshots.getReadBuffer();
+            if (snapshot.hudSequence != shownHudSequence)
+            {
+                shownHudSequence = snapshot.hudSequence;
+                animatedText.setContent(snapshot.hudMessage);
+                animatedText.revive(time, snapshot.hudTimeToLive);
+            }
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            Vector2 playerPosition = snapshot.getPlayerPosition(now);
+            // Every animation is worked out from this, physics used the same clock to decide when lasers are on
+            double animationTime = snapshot.getSimulationTime(now);
+            animations.update(animationTime);
             isRunning = !WindowShouldClose();
             resolution.x = GetRenderWidth();
             resolution.y = GetRenderHeight();
             mousePosition = GetMousePosition();
             hypotenuse = std::sqrt((resolution.x * resolution.x) + (resolution.y * resolution.y));
             platformer::blocks::inGameCamera.offset = {resolution.x / 2, resolution.y / 2};
-            platformer::blocks::inGameCamera.target = player.getPosition();
+            platformer::blocks::inGameCamera.target = playerPosition;
+            std::chrono::steady_clock::time_point renderStart = std::chrono::steady_clock::now();
             BeginDrawing();
             ClearBackground(background);
             if (isPaused)
@@ -111,30 +126,40 @@ int main(int argc, char **argv)
             }
             else
             {
+                {
+                    Vector2 topLeft = GetScreenToWorld2D({0, 0}, platformer::blocks::inGameCamera);
+                    Vector2 bottomRight = GetScreenToWorld2D(resolution, platformer::blocks::inGameCamera);
+                    std::chrono::steady_clock::time_point cullingStart = std::chrono::steady_clock::now();
+                    culler.update({topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y}, staticBlocks, animatedBlocks);
+                    frameStatistics.culling.add(platformer::stats::microsecondsSince(cullingStart));
+                    staticChunks.setMemoryBudget(platformer::settings::chunkCacheMegabytes * 1024 * 1024);
+                    staticChunks.prepare({topLeft.x, topLeft.y, bottomRight.x - topLeft.x, bottomRight.y - topLeft.y}, staticBlocks, spritesheet);
+                }
                 BeginMode2D(platformer::blocks::inGameCamera);
                 // Draw laser beams
-                for (int i = 0; i < animatedBlocks.size(); i++)
                 {
-                    if (animatedBlocks.at(i).getType() == platformer::valuesOfBlocks::LaserNoTimeOffset && animatedBlocks.at(i).getFrameDisplayed() == 1)
+                    PROFILE_ZONE("Draw beams");
+                    for (int i : culler.getVisibleBeams())
                     {
-                        animatedBlocks.at(i).setIterablePointer(&globalIterables[0]);
-                        DrawLineEx(animatedBlocks.at(i).getRayBegin(), animatedBlocks.at(i).getRayEnd(), 28, {0, 255, 0, 255});
+                        if (animations.getFrame(i) == 1)
+                        {
+                            renderer.addLine(platformer::BeamLayer, animatedBlocks.at(i).getRayBegin(), animatedBlocks.at(i).getRayEnd(), 28, {0, 255, 0, 255});
+                        }
                     }
                 }
-                // Draw regular blocks
-                for (int i = 0; i < staticBlocks.size(); i++)
+                // Draw regular blocks, mostly as whole chunks baked by prepare
+                staticChunks.draw(renderer, staticBlocks, spritesheet);
+                // Draw other animated blocks
                 {
-                    if (staticBlocks.at(i).getVisibility())
+                    PROFILE_ZONE("Draw animated blocks");
+                    for (int i : culler.getVisibleAnimated())
                     {
-                        staticBlocks.at(i).draw(spritesheet);
+                        animatedBlocks.at(i).draw(renderer, spritesheet, animations.getFrame(i));
                     }
                 }
-                // Draw other animated blocks
-                for (int i = 0; i < animatedBlocks.size(); i++)
-                {
-                    animatedBlocks.at(i).draw(spritesheet);
-                }
-                player.draw(spritesheet);
+                player.drawAt(renderer, spritesheet, playerPosition, snapshot.faceDirection, animationTime);
+                // Everything above was only queued, this is where it is drawn
+                renderer.flush();
                 EndMode2D();
             }
             animatedText.draw(hypotenuse, time, 0.01f, resolution);
@@ -142,7 +167,11 @@ int main(int argc, char **argv)
             {
                 break;
             }
-            EndDrawing();
+            frameStatistics.render.add(platformer::stats::microsecondsSince(renderStart));
+            {
+                PROFILE_ZONE("EndDrawing");
+                EndDrawing();
+            }
             keypress = GetCharPressed();
             if (IsKeyPressed(KEY_SLASH))
             {
@@ -160,24 +189,29 @@ int main(int argc, char **argv)
             platformer::settings::activeKeypresses[1] = (IsKeyDown(KEY_A) xor (GetGamepadAxisMovement(0, 0) < 0));
             platformer::settings::activeKeypresses[2] = (IsKeyDown(KEY_SPACE) xor IsGamepadButtonDown(0, GAMEPAD_BUTTON_RIGHT_FACE_DOWN));
             platformer::settings::activeKeypresses[3] = (IsKeyDown(KEY_MINUS) xor IsGamepadButtonDown(0, GAMEPAD_BUTTON_LEFT_FACE_DOWN));
-            if (player.getReloadStatus())
+            if (snapshot.reloadLevel)
             {
+                reachedPortal = 1;
                 break;
             }
         }
         
         workerStatus = 0;
-        every100ms.join();
-        everyOneSec.join();
-        every16ms.join();
-        optimization.join();
+        platformer::jobs::pool.wait(physics);
+        if (reachedPortal)
+        {
+            filename = nextLevel;
+            SaveFileText(".savedata", (char *)filename.c_str());
+        }
         staticBlocks.clear();
         animatedBlocks.clear();
+        staticGrid.clear();
     }
-    StopMusicStream(*platformer::music::activeMusic);
     platformer::music::release();
+    staticChunks.clear();
     UnloadTexture(spritesheet);
     UnloadImage(windowIcon);
+    platformer::jobs::release();
     CloseAudioDevice();
     CloseWindow();
 }
\ No newline at end of file